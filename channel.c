@@ -15,10 +15,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <linux/async.h>
 #include <linux/atomic.h>
 #include <linux/bitmap.h>
 #include <linux/clk.h>
 #include <linux/delay.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
 #include <linux/nvhost.h>
 #include <linux/lcm.h>
 #include <linux/list.h>
@@ -31,6 +34,7 @@
 #include <linux/semaphore.h>
 #include <linux/version.h>
 
+#include <media/media-device.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-event.h>
 #include <media/v4l2-dev.h>
@@ -48,6 +52,9 @@
 #include <linux/clk/tegra.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/camera_common.h>
+#include "trace_tegra_channel.h"
+#include "sensor_props_blob.h"
+#include "tegra_gang.h"
 
 #include "mipical/mipi_cal.h"
 
@@ -55,13 +62,142 @@
 #include "nvcsi/nvcsi.h"
 #include "nvcsi/deskew.h"
 
+/* the per-channel state below lives in the extended mc_common.h */
+#ifndef TEGRA_CHANNEL_EXT_FIELDS
+#error "mc_common.h lacks TEGRA_CHANNEL_EXT_FIELDS, see tegra_channel_ext.h"
+#endif
+
 #define TPG_CSI_GROUP_ID	10
 #define HDMI_IN_RATE 550000000
-/* number of lanes per brick */
-#define NUM_LANES_PER_BRICK	4
+/* embedded data lines are stored as 16-bit words in memory */
+#define EMB_BYTES_PER_PIXEL	2
+/* metadata format of the per-frame embedded sensor data */
+#define TEGRA_META_FMT_EMB_DATA	v4l2_fourcc('T', 'E', 'M', 'B')
+/* a few frames at the slowest sensor rate */
+#define TEGRA_EMB_STOP_TIMEOUT_MS	1000
+
+#define TEGRA_CAMERA_CID_VI_DROP_POLICY		(TEGRA_CAMERA_CID_BASE + 120)
+#define TEGRA_CAMERA_CID_VI_DROP_COUNTERS	(TEGRA_CAMERA_CID_BASE + 121)
+
+#define TEGRA_CAMERA_CID_VI_RECOVERY_COUNTERS	(TEGRA_CAMERA_CID_BASE + 122)
+#define TEGRA_CAMERA_CID_VI_RECOVERY_TIME_HIST	(TEGRA_CAMERA_CID_BASE + 123)
+#define TEGRA_CAMERA_CID_VI_RECOVERY_LOST_HIST	(TEGRA_CAMERA_CID_BASE + 124)
+#define TEGRA_CAMERA_CID_VI_WARM_RESTART	(TEGRA_CAMERA_CID_BASE + 125)
+#define TEGRA_CAMERA_CID_SENSOR_PROPS_BLOB	(TEGRA_CAMERA_CID_BASE + 126)
+#define TEGRA_CAMERA_CID_VI_GANG_SPLIT		(TEGRA_CAMERA_CID_BASE + 127)
+#define TEGRA_CAMERA_CID_VI_DROP_EPISODES	(TEGRA_CAMERA_CID_BASE + 128)
+#define TEGRA_CAMERA_CID_VI_REQUEST_LATENCY	(TEGRA_CAMERA_CID_BASE + 129)
+
+/* frames between writing a sensor control and the frame it lands on */
+#define TEGRA_REQUEST_LATENCY_DEF	2
+#define TEGRA_REQUEST_LATENCY_MAX	4
+
+#define TEGRA_SENSOR_PROPS_SECTION_MAX(type)				\
+	ALIGN(MAX_NUM_SENSOR_MODES * sizeof(struct type), 8)
+#define TEGRA_SENSOR_PROPS_BLOB_MAX_SIZE				\
+	(sizeof(struct tegra_sensor_props_blob_hdr) +			\
+	 TEGRA_SENSOR_PROPS_SECTION_MAX(sensor_signal_properties) +	\
+	 TEGRA_SENSOR_PROPS_SECTION_MAX(sensor_image_properties) +	\
+	 TEGRA_SENSOR_PROPS_SECTION_MAX(sensor_control_properties) +	\
+	 TEGRA_SENSOR_PROPS_SECTION_MAX(sensor_dv_timings))
+
+/* open-addressed format index, kept at most half full */
+#define TEGRA_FMT_HASH_BITS	7
+#define TEGRA_FMT_HASH_SIZE	(1 << TEGRA_FMT_HASH_BITS)
+
+/*
+ * Per-channel lookup index over chan->video_formats. Every slot and link
+ * holds a video_formats index + 1 so that zero marks an empty entry.
+ */
+struct tegra_channel_fmt_index {
+	u8 by_fourcc[TEGRA_FMT_HASH_SIZE];
+	u8 by_code[TEGRA_FMT_HASH_SIZE];
+	/* next format with the same mbus code, in table order */
+	u8 code_next[MAX_FORMAT_NUM];
+	/* fmts_bitmap compiled into VIDIOC_ENUM_FMT order */
+	u32 enum_fourcc[MAX_FORMAT_NUM];
+	unsigned int num_enum;
+};
+
+/* memoized TRY_FMT results per channel, replaced round robin */
+#define TEGRA_TRY_CACHE_ENTRIES	8
+
+/* everything __tegra_channel_try_format() reads from the request */
+struct tegra_channel_try_key {
+	u32 generation;
+	u32 pixelformat;
+	u32 width;
+	u32 height;
+	u32 bytesperline;
+	u32 field;
+	u32 colorspace;
+	u32 ycbcr_enc;
+	u32 quantization;
+	u32 xfer_func;
+	u32 width_align;
+	u32 height_align;
+	u32 stride_align;
+	u32 size_align;
+	/* the sizeimage of NV16 depends on the active format */
+	u32 active_fourcc;
+	/* pattern generator modes skip the CSI brick check */
+	u32 pg_mode;
+	/*
+	 * The sensor's TRY negotiation follows its active mode, which can
+	 * change behind the channel through the subdev node or the sensor
+	 * mode control.
+	 */
+	u32 sd_code;
+	u32 sd_width;
+	u32 sd_height;
+	s64 sd_mode_id;
+};
+
+struct tegra_channel_try_cache {
+	spinlock_t lock;
+	/* bumped on every change that can alter a negotiated format */
+	u32 generation;
+	unsigned int next;
+	struct {
+		struct tegra_channel_try_key key;
+		struct v4l2_pix_format pix;
+	} entry[TEGRA_TRY_CACHE_ENTRIES];
+};
+
+/* channel-owned controls whose applied value is remembered */
+#define TEGRA_CTRL_CACHE_SIZE	64
+
+/* last value tegra_channel_s_ctrl() pushed down, per control id */
+struct tegra_channel_ctrl_cache {
+	unsigned int num;
+	struct {
+		u32 id;
+		s32 val;
+	} entry[TEGRA_CTRL_CACHE_SIZE];
+};
+
+/* how a ganged frame is split between the CSI bricks */
+enum tegra_channel_gang_split {
+	TEGRA_GANG_SPLIT_AUTO = 0,
+	TEGRA_GANG_SPLIT_L_R,
+	TEGRA_GANG_SPLIT_R_L,
+	TEGRA_GANG_SPLIT_T_B,
+	TEGRA_GANG_SPLIT_B_T,
+};
 
 static s64 queue_init_ts;
 
+/* channels are brought up and torn down concurrently in this domain */
+static ASYNC_DOMAIN_EXCLUSIVE(tegra_vi_chan_domain);
+/* serializes the vb2 allocator refcount shared by all channels */
+static DEFINE_MUTEX(tegra_vi_dma_lock);
+
+struct tegra_channel_async_work {
+	struct tegra_channel *chan;
+	int ret;
+	s64 time_us;
+};
+
 static bool tegra_channel_verify_focuser(struct tegra_channel *chan)
 {
 	char *focuser;
@@ -79,26 +215,34 @@ static bool tegra_channel_verify_focuser(struct tegra_channel *chan)
 
 static void gang_buffer_offsets(struct tegra_channel *chan)
 {
-	int i;
+	int i, slot;
 	u32 offset = 0;
 
 	for (i = 0; i < chan->total_ports; i++) {
+		/* R/L and B/T: the first brick fills the last slice */
+		slot = i;
 		switch (chan->gang_mode) {
 		case CAMERA_NO_GANG_MODE:
 		case CAMERA_GANG_L_R:
+			offset = chan->gang_bytesperline;
+			break;
 		case CAMERA_GANG_R_L:
 			offset = chan->gang_bytesperline;
+			slot = chan->total_ports - 1 - i;
 			break;
 		case CAMERA_GANG_T_B:
+			offset = chan->gang_sizeimage;
+			break;
 		case CAMERA_GANG_B_T:
 			offset = chan->gang_sizeimage;
+			slot = chan->total_ports - 1 - i;
 			break;
 		default:
 			offset = 0;
 		}
 		offset = ((offset + TEGRA_SURFACE_ALIGNMENT - 1) &
 					~(TEGRA_SURFACE_ALIGNMENT - 1));
-		chan->buffer_offset[i] = i * offset;
+		chan->buffer_offset[i] = slot * offset;
 	}
 	spec_bar();
 }
@@ -123,6 +267,21 @@ static u32 gang_mode_height(enum camera_gang_mode gang_mode,
 		return height;
 }
 
+static void tegra_channel_try_cache_invalidate(struct tegra_channel *chan)
+{
+	struct tegra_channel_try_cache *tc = chan->try_cache;
+	unsigned long flags;
+
+	if (!tc)
+		return;
+
+	spin_lock_irqsave(&tc->lock, flags);
+	/* generation 0 is never valid so zeroed entries cannot hit */
+	if (!++tc->generation)
+		tc->generation = 1;
+	spin_unlock_irqrestore(&tc->lock, flags);
+}
+
 static void update_gang_mode_params(struct tegra_channel *chan)
 {
 	chan->gang_width = gang_mode_width(chan->gang_mode,
@@ -133,24 +292,143 @@ static void update_gang_mode_params(struct tegra_channel *chan)
 					chan->fmtinfo->bpp.numerator) /
 					chan->fmtinfo->bpp.denominator);
 	chan->gang_sizeimage = chan->gang_bytesperline *
-					chan->format.height;
+					chan->gang_height;
 	gang_buffer_offsets(chan);
 }
 
+static void tegra_channel_get_sensor_peak_vals(struct tegra_channel *chan,
+						u64 *pixelclock, u32 *num_lanes);
+
+static struct sensor_mode_properties *tegra_channel_mode_by_size(
+		struct camera_common_data *s_data, u32 width, u32 height)
+{
+	struct sensor_image_properties *image;
+	int i;
+
+	for (i = 0; i < s_data->sensor_props.num_modes; i++) {
+		image = &s_data->sensor_props.sensor_modes[i].image_properties;
+		if (image->width == width && image->height == height)
+			return &s_data->sensor_props.sensor_modes[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Pixel rate and lane count of the sensor mode being streamed. Falls back
+ * to the mode matching the channel format, then to the sensor's peak
+ * values. Returns false if the sensor has no mode table.
+ */
+static bool tegra_channel_get_mode_vals(struct tegra_channel *chan,
+		u64 *pixel_rate, u32 *num_lanes)
+{
+	struct camera_common_data *s_data;
+	struct sensor_mode_properties *mode = NULL;
+	struct sensor_signal_properties *signal;
+
+	if (!chan->subdev_on_csi)
+		return false;
+	s_data = to_camera_common_data(chan->subdev_on_csi->dev);
+	if (!s_data || !s_data->sensor_props.num_modes)
+		return false;
+
+	if (s_data->mode_prop_idx < s_data->sensor_props.num_modes)
+		mode = &s_data->sensor_props.sensor_modes[
+				s_data->mode_prop_idx];
+	if (!mode)
+		mode = tegra_channel_mode_by_size(s_data, chan->format.width,
+				chan->format.height);
+	if (!mode) {
+		tegra_channel_get_sensor_peak_vals(chan, pixel_rate,
+				num_lanes);
+		return true;
+	}
+
+	signal = &mode->signal_properties;
+	*pixel_rate = signal->serdes_pixel_clock.val ?
+		signal->serdes_pixel_clock.val : signal->pixel_clock.val;
+	*num_lanes = signal->num_lanes;
+
+	return true;
+}
+
+/*
+ * CSI bricks the sensor mode of @width x @height needs in format @vfmt,
+ * 0 if the sensor has no mode table or no mode of that size.
+ */
+static u32 tegra_channel_mode_bricks(struct tegra_channel *chan,
+		u32 width, u32 height, const struct tegra_video_format *vfmt)
+{
+	struct camera_common_data *s_data;
+	struct sensor_mode_properties *mode;
+	struct sensor_signal_properties *signal;
+
+	if (!chan->subdev_on_csi)
+		return 0;
+	s_data = to_camera_common_data(chan->subdev_on_csi->dev);
+	if (!s_data)
+		return 0;
+	mode = tegra_channel_mode_by_size(s_data, width, height);
+	if (!mode)
+		return 0;
+
+	signal = &mode->signal_properties;
+	return tegra_channel_gang_bricks(signal->serdes_pixel_clock.val ?
+			signal->serdes_pixel_clock.val :
+			signal->pixel_clock.val,
+			signal->num_lanes, vfmt->width);
+}
+
+static enum camera_gang_mode tegra_channel_gang_split_mode(
+		struct tegra_channel *chan)
+{
+	u32 half_bpl;
+
+	switch (chan->gang_split) {
+	case TEGRA_GANG_SPLIT_L_R:
+		return CAMERA_GANG_L_R;
+	case TEGRA_GANG_SPLIT_R_L:
+		return CAMERA_GANG_R_L;
+	case TEGRA_GANG_SPLIT_T_B:
+		return CAMERA_GANG_T_B;
+	case TEGRA_GANG_SPLIT_B_T:
+		return CAMERA_GANG_B_T;
+	default:
+		break;
+	}
+
+	/* side by side unless half a line breaks the stride alignment */
+	half_bpl = (chan->format.width >> 1) * chan->fmtinfo->bpp.numerator /
+			chan->fmtinfo->bpp.denominator;
+	if (half_bpl % chan->stride_align && !(chan->format.height & 1))
+		return CAMERA_GANG_T_B;
+
+	return CAMERA_GANG_L_R;
+}
+
 static void update_gang_mode(struct tegra_channel *chan)
 {
-	int width = chan->format.width;
-	int height = chan->format.height;
+	u64 pixel_rate = 0;
+	u32 num_lanes = 0;
+	u32 bricks;
 
-	/*
-	 * At present only 720p, 1080p and 4k resolutions
-	 * are supported and only 4K requires gang mode
-	 * Update this code with CID for future extensions
-	 * Also, validate width and height of images based
-	 * on gang mode and surface stride alignment
-	 */
-	if ((width > 1920) && (height > 1080)) {
-		chan->gang_mode = CAMERA_GANG_L_R;
+	if (tegra_channel_get_mode_vals(chan, &pixel_rate, &num_lanes)) {
+		bricks = tegra_channel_gang_bricks(pixel_rate, num_lanes,
+				chan->fmtinfo->width);
+	} else {
+		/* no mode table (e.g. HDMI-in), keep the 4K rule */
+		bricks = (chan->format.width > 1920 &&
+				chan->format.height > 1080) ? 2 : 1;
+	}
+
+	if (bricks > 1 && !chan->pg_mode) {
+		/* try/s_fmt reject this, only DV timings and defaults get here */
+		if (bricks > chan->total_ports)
+			dev_warn(chan->vi->dev,
+				"%ux%u needs %u CSI bricks, channel has %u\n",
+				chan->format.width, chan->format.height,
+				bricks, chan->total_ports);
+		chan->gang_mode = tegra_channel_gang_split_mode(chan);
 		chan->valid_ports = chan->total_ports;
 	} else {
 		chan->gang_mode = CAMERA_NO_GANG_MODE;
@@ -158,6 +436,7 @@ static void update_gang_mode(struct tegra_channel *chan)
 	}
 
 	update_gang_mode_params(chan);
+	tegra_channel_try_cache_invalidate(chan);
 }
 
 static u32 get_aligned_buffer_size(struct tegra_channel *chan,
@@ -279,6 +558,7 @@ static void tegra_channel_update_format(struct tegra_channel *chan,
 	chan->format.bytesperline = preferred_stride ?: bytesperline;
 	chan->buffer_offset[0] = 0;
 	chan->interlace_bplfactor = 1;
+	tegra_channel_try_cache_invalidate(chan);
 
 	dev_dbg(&chan->video->dev,
 			"%s: Resolution= %dx%d bytesperline=%d\n",
@@ -302,6 +582,219 @@ static void tegra_channel_update_format(struct tegra_channel *chan,
 		chan->format.sizeimage *= 2;
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Multi-planar format helpers
+ * -----------------------------------------------------------------------------
+ */
+/*
+ * A channel opts in to the multi-planar API with a boolean
+ * "nvidia,multiplanar" on its VI port node. This only changes the buffer
+ * type, every format keeps its single contiguous plane. Separate luma and
+ * chroma dma-bufs (NV16M) are not supported: the VI fops program one
+ * surface per buffer from buf->addr, and teaching vi4/vi5 to program a
+ * second surface is a change to those files, which are not part of this
+ * tree.
+ */
+static bool tegra_channel_port_multiplanar(struct tegra_channel *chan)
+{
+	struct device_node *ports, *port;
+	bool multiplanar = false;
+	u32 reg;
+
+	if (chan->pg_mode)
+		return false;
+
+	ports = of_get_child_by_name(chan->vi->dev->of_node, "ports");
+	if (!ports)
+		return false;
+
+	for_each_child_of_node(ports, port) {
+		if (of_node_cmp(port->name, "port") ||
+		    of_property_read_u32(port, "reg", &reg) ||
+		    reg != chan->id)
+			continue;
+		multiplanar = of_property_read_bool(port, "nvidia,multiplanar");
+		of_node_put(port);
+		break;
+	}
+	of_node_put(ports);
+
+	return multiplanar;
+}
+
+static void tegra_channel_pix_to_mplane(const struct v4l2_pix_format *pix,
+				struct v4l2_pix_format_mplane *mp)
+{
+	memset(mp->reserved, 0, sizeof(mp->reserved));
+	mp->width = pix->width;
+	mp->height = pix->height;
+	mp->pixelformat = pix->pixelformat;
+	mp->field = pix->field;
+	mp->colorspace = pix->colorspace;
+	mp->ycbcr_enc = pix->ycbcr_enc;
+	mp->quantization = pix->quantization;
+	mp->xfer_func = pix->xfer_func;
+	mp->flags = pix->flags;
+	mp->num_planes = 1;
+	memset(mp->plane_fmt[0].reserved, 0, sizeof(mp->plane_fmt[0].reserved));
+	mp->plane_fmt[0].bytesperline = pix->bytesperline;
+	mp->plane_fmt[0].sizeimage = pix->sizeimage;
+}
+
+static void tegra_channel_mplane_to_pix(const struct v4l2_pix_format_mplane *mp,
+				struct v4l2_pix_format *pix)
+{
+	memset(pix, 0, sizeof(*pix));
+	pix->width = mp->width;
+	pix->height = mp->height;
+	pix->pixelformat = mp->pixelformat;
+	pix->field = mp->field;
+	pix->colorspace = mp->colorspace;
+	pix->ycbcr_enc = mp->ycbcr_enc;
+	pix->quantization = mp->quantization;
+	pix->xfer_func = mp->xfer_func;
+	pix->flags = mp->flags;
+	pix->bytesperline = mp->num_planes ? mp->plane_fmt[0].bytesperline : 0;
+}
+
+static void tegra_channel_set_payload(struct tegra_channel *chan,
+				struct vb2_buffer *vb)
+{
+	vb2_set_plane_payload(vb, 0, chan->format.sizeimage);
+}
+
+static u32 tegra_channel_fmt_fourcc(struct tegra_channel *chan, int idx)
+{
+	return chan->video_formats[idx]->fourcc;
+}
+
+static u32 tegra_channel_fmt_code(struct tegra_channel *chan, int idx)
+{
+	return chan->video_formats[idx]->code;
+}
+
+/*
+ * Probe @slots for @key. Returns the slot holding the first format
+ * matching @key, or the empty slot where it would be inserted.
+ */
+static unsigned int tegra_channel_fmt_probe(struct tegra_channel *chan,
+			const u8 *slots, u32 key,
+			u32 (*key_of)(struct tegra_channel *, int))
+{
+	unsigned int slot = hash_32(key, TEGRA_FMT_HASH_BITS);
+
+	while (slots[slot] && key_of(chan, slots[slot] - 1) != key)
+		slot = (slot + 1) & (TEGRA_FMT_HASH_SIZE - 1);
+
+	return slot;
+}
+
+static int tegra_channel_fmt_index_build(struct tegra_channel *chan)
+{
+	struct tegra_channel_fmt_index *fi = chan->fmt_index;
+	unsigned int num = min_t(unsigned int, chan->num_video_formats,
+				MAX_FORMAT_NUM);
+	unsigned int i, slot;
+	int idx;
+
+	BUILD_BUG_ON(TEGRA_FMT_HASH_SIZE < 2 * MAX_FORMAT_NUM);
+	BUILD_BUG_ON(MAX_FORMAT_NUM >= U8_MAX);
+
+	if (!fi) {
+		fi = devm_kzalloc(chan->vi->dev, sizeof(*fi), GFP_KERNEL);
+		if (!fi)
+			return -ENOMEM;
+		chan->fmt_index = fi;
+	}
+	memset(fi, 0, sizeof(*fi));
+
+	for (i = 0; i < num; i++) {
+		/* keep the first entry per fourcc, as the table scan did */
+		slot = tegra_channel_fmt_probe(chan, fi->by_fourcc,
+				tegra_channel_fmt_fourcc(chan, i),
+				tegra_channel_fmt_fourcc);
+		if (!fi->by_fourcc[slot])
+			fi->by_fourcc[slot] = i + 1;
+
+		/* chain formats sharing an mbus code behind the first one */
+		slot = tegra_channel_fmt_probe(chan, fi->by_code,
+				tegra_channel_fmt_code(chan, i),
+				tegra_channel_fmt_code);
+		if (!fi->by_code[slot]) {
+			fi->by_code[slot] = i + 1;
+			continue;
+		}
+		idx = fi->by_code[slot] - 1;
+		while (fi->code_next[idx])
+			idx = fi->code_next[idx] - 1;
+		fi->code_next[idx] = i + 1;
+	}
+
+	return 0;
+}
+
+static int tegra_channel_fmt_idx_by_fourcc(struct tegra_channel *chan,
+			u32 fourcc)
+{
+	struct tegra_channel_fmt_index *fi = chan->fmt_index;
+	unsigned int slot;
+
+	slot = tegra_channel_fmt_probe(chan, fi->by_fourcc, fourcc,
+				tegra_channel_fmt_fourcc);
+
+	return (int)fi->by_fourcc[slot] - 1;
+}
+
+/* first format with @code, or -1 */
+static int tegra_channel_fmt_idx_by_code(struct tegra_channel *chan,
+			u32 code)
+{
+	struct tegra_channel_fmt_index *fi = chan->fmt_index;
+	unsigned int slot;
+
+	slot = tegra_channel_fmt_probe(chan, fi->by_code, code,
+				tegra_channel_fmt_code);
+
+	return (int)fi->by_code[slot] - 1;
+}
+
+/* next format after @idx with the same mbus code, or -1 */
+static int tegra_channel_fmt_idx_next_code(struct tegra_channel *chan,
+			int idx)
+{
+	return (int)chan->fmt_index->code_next[idx] - 1;
+}
+
+static const struct tegra_video_format *
+tegra_channel_format_by_fourcc(struct tegra_channel *chan, u32 fourcc)
+{
+	int idx = tegra_channel_fmt_idx_by_fourcc(chan, fourcc);
+
+	return idx < 0 ? NULL : chan->video_formats[idx];
+}
+
+static const struct tegra_video_format *
+tegra_channel_format_by_code(struct tegra_channel *chan, u32 code)
+{
+	int idx = tegra_channel_fmt_idx_by_code(chan, code);
+
+	return idx < 0 ? NULL : chan->video_formats[idx];
+}
+
+/* flatten fmts_bitmap so enumeration is a single array read */
+static void tegra_channel_fmts_enum_build(struct tegra_channel *chan)
+{
+	struct tegra_channel_fmt_index *fi = chan->fmt_index;
+	unsigned int idx, n = 0;
+
+	for_each_set_bit(idx, chan->fmts_bitmap, MAX_FORMAT_NUM) {
+		fi->enum_fourcc[n] = tegra_channel_fmt_fourcc(chan, idx);
+		n++;
+	}
+	fi->num_enum = n;
+}
+
 static void tegra_channel_fmts_bitmap_init(struct tegra_channel *chan)
 {
 	int ret, pixel_format_index = 0, init_code = 0;
@@ -331,15 +824,15 @@ static void tegra_channel_fmts_bitmap_init(struct tegra_channel *chan)
 			break;
 
 		pixel_format_index =
-			tegra_core_get_idx_by_code(chan, code.code, 0);
+			tegra_channel_fmt_idx_by_code(chan, code.code);
 		while (pixel_format_index >= 0) {
 			bitmap_set(chan->fmts_bitmap, pixel_format_index, 1);
 			/* Set init_code to the first matched format */
 			if (!init_code)
 				init_code = code.code;
 			/* Look for other formats with the same mbus code */
-			pixel_format_index = tegra_core_get_idx_by_code(chan,
-				code.code, pixel_format_index + 1);
+			pixel_format_index = tegra_channel_fmt_idx_next_code(chan,
+				pixel_format_index);
 		}
 
 		code.index++;
@@ -347,12 +840,14 @@ static void tegra_channel_fmts_bitmap_init(struct tegra_channel *chan)
 
 	if (!init_code) {
 		pixel_format_index =
-			tegra_core_get_idx_by_code(chan, TEGRA_VF_DEF, 0);
+			tegra_channel_fmt_idx_by_code(chan, TEGRA_VF_DEF);
 		if (pixel_format_index >= 0) {
 			bitmap_set(chan->fmts_bitmap, pixel_format_index, 1);
 			init_code = TEGRA_VF_DEF;
 		}
 	}
+	tegra_channel_fmts_enum_build(chan);
+
 		/* Get the format based on active code of the sub-device */
 	ret = v4l2_subdev_call(subdev, pad, get_fmt, &cfg, &fmt);
 	if (ret)
@@ -360,7 +855,7 @@ static void tegra_channel_fmts_bitmap_init(struct tegra_channel *chan)
 
 	/* Initiate the channel format to the first matched format */
 	chan->fmtinfo =
-		tegra_core_get_format_by_code(chan, fmt.format.code, 0);
+		tegra_channel_format_by_code(chan, fmt.format.code);
 	if (!chan->fmtinfo)
 		return;
 
@@ -394,6 +889,130 @@ void set_timestamp(struct tegra_channel_buffer *buf,
 	buf->buf.vb2_buf.timestamp = (u64)timespec_to_ns(ts);
 #else
 	buf->buf.vb2_buf.timestamp = (u64)timespec64_to_ns(ts);
+#endif
+	trace_tegra_channel_eof(buf->chan->id, buf->buf.vb2_buf.index,
+		buf->frame_seq);
+}
+
+static u32 tegra_channel_emb_size(struct tegra_channel *chan)
+{
+	return chan->embedded_data_width * EMB_BYTES_PER_PIXEL *
+		chan->embedded_data_height;
+}
+
+/*
+ * Only VI5 builds a capture descriptor per frame and reads chan->emb_buf
+ * for each of them (vi5_setup_surface, right after dequeue_buffer). VI2
+ * and VI4 program the embedded surface once per stream, so a per-frame
+ * buffer would keep being written after it was returned. VI5 is the one
+ * with a per-unit device handle.
+ */
+static bool tegra_channel_emb_per_frame(struct tegra_channel *chan)
+{
+	return chan->vi->fops && chan->vi->fops->vi_unit_get_device_handle;
+}
+
+/*
+ * Pick the buffer the embedded data of the frame captured into `buf`
+ * is written to. When the metadata node has a buffer queued it is moved
+ * to the active list and lent to the VI as chan->emb_buf, which the VI5
+ * fops program into the capture descriptor of this frame. Otherwise the
+ * VI's own scratch buffer is put back and the lines are not delivered.
+ * The attached buffer points back at `buf` through its own emb_buf so
+ * stop_streaming can detach it.
+ */
+static void tegra_channel_emb_attach(struct tegra_channel *chan,
+			struct tegra_channel_buffer *buf)
+{
+	struct tegra_channel_buffer *mbuf = NULL;
+	dma_addr_t scratch;
+
+	spin_lock(&chan->emb_lock);
+	scratch = chan->emb_scratch ? chan->emb_scratch : chan->emb_buf;
+	if (!list_empty(&chan->emb_capture)) {
+		mbuf = list_first_entry(&chan->emb_capture,
+			struct tegra_channel_buffer, queue);
+		list_move_tail(&mbuf->queue, &chan->emb_active);
+		mbuf->emb_buf = buf;
+		chan->emb_scratch = scratch;
+		chan->emb_buf = mbuf->addr;
+	} else {
+		chan->emb_buf = scratch;
+		chan->emb_scratch = 0;
+	}
+	buf->emb_buf = mbuf;
+	spin_unlock(&chan->emb_lock);
+}
+
+/*
+ * Give the VI its scratch buffer back once it stopped capturing, the
+ * VI5 fops reallocate and tegra_channel_cleanup() frees chan->emb_buf.
+ */
+static void tegra_channel_emb_restore(struct tegra_channel *chan)
+{
+	spin_lock(&chan->emb_lock);
+	if (chan->emb_scratch) {
+		chan->emb_buf = chan->emb_scratch;
+		chan->emb_scratch = 0;
+	}
+	spin_unlock(&chan->emb_lock);
+}
+
+/*
+ * Hand the metadata buffer attached to `buf` back to user-space with the
+ * image buffer's sequence and timestamp so both can be matched up.
+ * Must be called before the image buffer itself is returned.
+ */
+static void tegra_channel_emb_complete(struct tegra_channel_buffer *buf,
+			enum vb2_buffer_state state)
+{
+	struct tegra_channel *chan = buf->chan;
+	struct tegra_channel_buffer *mbuf;
+	struct vb2_v4l2_buffer *mvbuf;
+
+	/* already returned if the metadata queue stopped in the meantime */
+	spin_lock(&chan->emb_lock);
+	mbuf = buf->emb_buf;
+	if (mbuf) {
+		list_del_init(&mbuf->queue);
+		mbuf->emb_buf = NULL;
+		buf->emb_buf = NULL;
+	}
+	spin_unlock(&chan->emb_lock);
+
+	if (!mbuf)
+		return;
+	/* the metadata queue may be waiting for its last buffers */
+	wake_up(&chan->emb_wait);
+
+	mvbuf = &mbuf->buf;
+	mvbuf->sequence = buf->buf.sequence;
+	mvbuf->field = V4L2_FIELD_NONE;
+	mvbuf->vb2_buf.timestamp = buf->buf.vb2_buf.timestamp;
+	vb2_set_plane_payload(&mvbuf->vb2_buf, 0,
+		tegra_channel_emb_size(buf->chan));
+	vb2_buffer_done(&mvbuf->vb2_buf, state);
+}
+
+/*
+ * Complete what goes back to user-space alongside the image buffer: its
+ * metadata buffer and, if it never went out, the controls of its
+ * request. Sleeps, so no channel spinlock may be held.
+ * Must be called right before the image buffer is returned.
+ */
+static void tegra_channel_buffer_complete(struct tegra_channel_buffer *buf,
+			enum vb2_buffer_state state)
+{
+	tegra_channel_emb_complete(buf, state);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	/*
+	 * Requeued buffers go back to their request untouched, applied
+	 * requests were completed when they went out.
+	 */
+	if (buf->buf.vb2_buf.req_obj.req && state != VB2_BUF_STATE_QUEUED &&
+			!buf->req_applied)
+		v4l2_ctrl_request_complete(buf->buf.vb2_buf.req_obj.req,
+			&buf->chan->ctrl_handler);
 #endif
 }
 
@@ -403,11 +1022,17 @@ void release_buffer(struct tegra_channel *chan,
 	struct vb2_v4l2_buffer *vbuf = &buf->buf;
 	s64 frame_arrived_ts = 0;
 
+	/*
+	 * The release-list path has no frame start event of its own, the
+	 * fops stamped the buffer with the frame's start of frame time.
+	 */
+	trace_tegra_channel_sof(chan->id, vbuf->vb2_buf.index, buf->frame_seq,
+		vbuf->vb2_buf.timestamp);
+
 	/* release one frame */
 	vbuf->sequence = chan->sequence++;
 	vbuf->field = V4L2_FIELD_NONE;
-	vb2_set_plane_payload(&vbuf->vb2_buf,
-		0, chan->format.sizeimage);
+	tegra_channel_set_payload(chan, &vbuf->vb2_buf);
 
 	/*
 	 * WAR to force buffer state if capture state is not good
@@ -422,6 +1047,9 @@ void release_buffer(struct tegra_channel *chan,
 		buf->state = VB2_BUF_STATE_ERROR;
 #endif
 
+	/* a good frame after a light recovery means it worked */
+	if (buf->state == VB2_BUF_STATE_DONE)
+		chan->recovery_pending = false;
 
 	if (chan->sequence == 1) {
 		/*
@@ -437,6 +1065,9 @@ void release_buffer(struct tegra_channel *chan,
 	dev_dbg(&chan->video->dev,
 		"%s: release buf[%p] frame[%d] to user-space\n",
 		__func__, buf, chan->sequence);
+	tegra_channel_buffer_complete(buf, buf->state);
+	trace_tegra_channel_vb2_done(chan->id, vbuf->vb2_buf.index,
+		buf->frame_seq, vbuf->sequence, buf->state);
 	vb2_buffer_done(&vbuf->vb2_buf, buf->state);
 }
 
@@ -449,6 +1080,9 @@ void release_buffer(struct tegra_channel *chan,
 void enqueue_inflight(struct tegra_channel *chan,
 			struct tegra_channel_buffer *buf)
 {
+	trace_tegra_channel_capture_submit(chan->id, buf->buf.vb2_buf.index,
+		buf->frame_seq);
+
 	/* Put buffer into the release queue */
 	spin_lock(&chan->release_lock);
 	list_add_tail(&buf->queue, &chan->release);
@@ -475,6 +1109,10 @@ struct tegra_channel_buffer *dequeue_inflight(struct tegra_channel *chan)
 		list_del_init(&buf->queue);
 
 	spin_unlock(&chan->release_lock);
+
+	if (buf)
+		trace_tegra_channel_ring_release(chan->id,
+			buf->buf.vb2_buf.index, buf->frame_seq);
 	return buf;
 }
 
@@ -488,12 +1126,16 @@ void tegra_channel_init_ring_buffer(struct tegra_channel *chan)
 	chan->capture_descr_index = 0;
 	chan->capture_descr_sequence = 0;
 	chan->queue_error = false;
+	chan->drop_starved = false;
+	chan->recovery_pending = false;
 }
 
 void free_ring_buffers(struct tegra_channel *chan, int frames)
 {
 	struct vb2_v4l2_buffer *vbuf;
+	struct tegra_channel_buffer *buf;
 	s64 frame_arrived_ts = 0;
+	int state;
 
 	spin_lock(&chan->buffer_lock);
 
@@ -502,6 +1144,7 @@ void free_ring_buffers(struct tegra_channel *chan, int frames)
 
 	while (frames > 0) {
 		vbuf = chan->buffers[chan->free_index];
+		buf = to_tegra_channel_buffer(vbuf);
 
 		/* Skip updating the buffer sequence with channel sequence
 		 * for interlaced captures and this instead will be updated
@@ -513,8 +1156,7 @@ void free_ring_buffers(struct tegra_channel *chan, int frames)
 			chan->sequence++;
 		/* release one frame */
 		vbuf->field = V4L2_FIELD_NONE;
-		vb2_set_plane_payload(&vbuf->vb2_buf,
-			0, chan->format.sizeimage);
+		tegra_channel_set_payload(chan, &vbuf->vb2_buf);
 
 		/*
 		 * WAR to force buffer state if capture state is not good
@@ -541,14 +1183,23 @@ void free_ring_buffers(struct tegra_channel *chan, int frames)
 				"%s: capture init latency is %lld ms\n",
 				__func__, (frame_arrived_ts - queue_init_ts));
 		}
-		vb2_buffer_done(&vbuf->vb2_buf,
-			chan->buffer_state[chan->free_index++]);
+		trace_tegra_channel_ring_release(chan->id, vbuf->vb2_buf.index,
+			buf->frame_seq);
+		state = chan->buffer_state[chan->free_index++];
 
 		if (chan->free_index >= chan->capture_queue_depth)
 			chan->free_index = 0;
 		chan->num_buffers--;
 		chan->released_bufs++;
 		frames--;
+
+		/* completing a request sleeps, the entry is off the ring */
+		spin_unlock(&chan->buffer_lock);
+		tegra_channel_buffer_complete(buf, state);
+		trace_tegra_channel_vb2_done(chan->id, vbuf->vb2_buf.index,
+			buf->frame_seq, vbuf->sequence, state);
+		vb2_buffer_done(&vbuf->vb2_buf, state);
+		spin_lock(&chan->buffer_lock);
 	}
 	spin_unlock(&chan->buffer_lock);
 }
@@ -586,6 +1237,162 @@ static void update_state_to_buffer(struct tegra_channel *chan, int state)
 		chan->buffer_state[chan->save_index] = state;
 }
 
+/*
+ * Account one recovery: its duration in microseconds and the number of
+ * frames it cost go to log2 histograms, the tier to the counters.
+ */
+static void tegra_channel_record_recovery(struct tegra_channel *chan,
+		enum tegra_channel_recovery_tier tier, ktime_t start, u32 lost)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	u32 bucket;
+
+	bucket = min_t(u32, fls64(us > 0 ? us : 0),
+			TEGRA_RECOVERY_HIST_BUCKETS - 1);
+	chan->recovery_time_hist[bucket]++;
+	bucket = min_t(u32, fls(lost), TEGRA_RECOVERY_HIST_BUCKETS - 1);
+	chan->recovery_lost_hist[bucket]++;
+	chan->recovery_count[tier]++;
+
+	dev_dbg(chan->vi->dev, "err_rec: tier %d took %lld us, %u frames lost\n",
+		tier, us, lost);
+}
+
+/* Number of the oldest `frames` ring entries that will be released bad */
+static u32 tegra_channel_ring_errors(struct tegra_channel *chan, int frames)
+{
+	int index = chan->free_index;
+	u32 errors = 0;
+
+	spin_lock(&chan->buffer_lock);
+	while (frames-- > 0) {
+		if (chan->buffer_state[index] != VB2_BUF_STATE_DONE)
+			errors++;
+		if (++index >= chan->capture_queue_depth)
+			index = 0;
+	}
+	spin_unlock(&chan->buffer_lock);
+
+	return errors;
+}
+
+/*
+ * Recover the ring after a bad frame. The light tier releases every
+ * completed entry and keeps the buffer currently in flight armed, so a
+ * single bad frame costs one frame. A second bad frame before a good one
+ * escalates to flushing the whole ring and re-initialising its state.
+ */
+static void tegra_channel_ring_recover(struct tegra_channel *chan)
+{
+	ktime_t start = ktime_get();
+	u32 lost;
+
+	if (!chan->recovery_pending && chan->num_buffers > 1) {
+		lost = tegra_channel_ring_errors(chan, chan->num_buffers - 1);
+		free_ring_buffers(chan, chan->num_buffers - 1);
+		chan->recovery_pending = true;
+		tegra_channel_record_recovery(chan, TEGRA_RECOVERY_LIGHT,
+			start, lost);
+		return;
+	}
+
+	lost = tegra_channel_ring_errors(chan, chan->num_buffers);
+	free_ring_buffers(chan, chan->num_buffers);
+	tegra_channel_init_ring_buffer(chan);
+	tegra_channel_record_recovery(chan, chan->recovery_pending ?
+		TEGRA_RECOVERY_ESCALATED : TEGRA_RECOVERY_FULL, start, lost);
+	chan->recovery_pending = false;
+}
+
+/*
+ * Take the oldest captured but not yet released buffer back from the
+ * ring and put it at the head of the capture queue so the next frame
+ * lands in it. Returns false if the ring holds no completed buffer.
+ */
+static bool tegra_channel_reclaim_oldest(struct tegra_channel *chan)
+{
+	struct vb2_v4l2_buffer *vbuf;
+	struct tegra_channel_buffer *buf;
+
+	spin_lock(&chan->buffer_lock);
+	/* the newest ring entry is the frame currently being captured */
+	if (chan->num_buffers < 2) {
+		spin_unlock(&chan->buffer_lock);
+		return false;
+	}
+
+	vbuf = chan->buffers[chan->free_index++];
+	if (chan->free_index >= chan->capture_queue_depth)
+		chan->free_index = 0;
+	chan->num_buffers--;
+	spin_unlock(&chan->buffer_lock);
+
+	buf = to_tegra_channel_buffer(vbuf);
+	tegra_channel_emb_complete(buf, VB2_BUF_STATE_ERROR);
+
+	/*
+	 * The dropped frame's result goes with it. The request bound to the
+	 * buffer stays applied, so re-arming must not run its setup again.
+	 */
+	buf->state = VB2_BUF_STATE_ACTIVE;
+	buf->req_applied = true;
+
+	spin_lock(&chan->start_lock);
+	list_add(&buf->queue, &chan->capture);
+	spin_unlock(&chan->start_lock);
+
+	wake_up_interruptible(&chan->start_wait);
+
+	return true;
+}
+
+/*
+ * Called on every frame start. When user-space has not returned any
+ * buffer the frame is handled according to the channel drop policy:
+ *  - block: capture stalls until a buffer is queued (legacy behaviour)
+ *  - drop-newest: completed frames are released right away and the
+ *    incoming frames are dropped until a buffer is queued
+ *  - drop-oldest: the oldest completed frame not yet handed to
+ *    user-space is dropped and its buffer reused for the incoming frame
+ * Every starved frame start loses one frame, either the incoming one or
+ * the reclaimed oldest, and counts once in drop_count. A run of starved
+ * frame starts counts once in drop_episodes.
+ */
+static void tegra_channel_apply_drop_policy(struct tegra_channel *chan)
+{
+	bool starved;
+
+	spin_lock(&chan->start_lock);
+	starved = list_empty(&chan->capture);
+	spin_unlock(&chan->start_lock);
+
+	if (!starved) {
+		chan->drop_starved = false;
+		return;
+	}
+
+	chan->drop_count[chan->drop_policy]++;
+	if (!chan->drop_starved)
+		chan->drop_episodes[chan->drop_policy]++;
+
+	switch (chan->drop_policy) {
+	case TEGRA_DROP_POLICY_DROP_NEWEST:
+		if (chan->num_buffers > 1)
+			free_ring_buffers(chan, chan->num_buffers - 1);
+		break;
+	case TEGRA_DROP_POLICY_DROP_OLDEST:
+		/* the incoming frame got a buffer, no longer starved */
+		if (tegra_channel_reclaim_oldest(chan))
+			return;
+		break;
+	case TEGRA_DROP_POLICY_BLOCK:
+	default:
+		break;
+	}
+
+	chan->drop_starved = true;
+}
+
 void tegra_channel_ring_buffer(struct tegra_channel *chan,
 					struct vb2_v4l2_buffer *vb,
 #if KERNEL_VERSION(5, 4, 0) > LINUX_VERSION_CODE
@@ -594,21 +1401,32 @@ void tegra_channel_ring_buffer(struct tegra_channel *chan,
 					struct timespec64 *ts, int state)
 #endif
 {
+#if KERNEL_VERSION(5, 4, 0) > LINUX_VERSION_CODE
+	trace_tegra_channel_sof(chan->id, vb->vb2_buf.index,
+		to_tegra_channel_buffer(vb)->frame_seq, timespec_to_ns(ts));
+#else
+	trace_tegra_channel_sof(chan->id, vb->vb2_buf.index,
+		to_tegra_channel_buffer(vb)->frame_seq, timespec64_to_ns(ts));
+#endif
+
 	if (!chan->bfirst_fstart)
 		chan->bfirst_fstart = true;
 	else
 		update_state_to_buffer(chan, state);
 
-	/* Capture state is not GOOD, release all buffers and re-init state */
+	/* Capture state is not GOOD, recover the ring */
 	if (chan->capture_state != CAPTURE_GOOD) {
-		free_ring_buffers(chan, chan->num_buffers);
-		tegra_channel_init_ring_buffer(chan);
+		tegra_channel_ring_recover(chan);
 		return;
 	} else {
+		/* a good frame after a light recovery means it worked */
+		chan->recovery_pending = false;
 		/* TODO: granular time code information */
 		vb->timecode.seconds = ts->tv_sec;
 	}
 
+	tegra_channel_apply_drop_policy(chan);
+
 	/* release buffer N at N+2 frame start event */
 	if (chan->num_buffers >= (chan->capture_queue_depth - 1))
 		free_ring_buffers(chan, 1);
@@ -625,10 +1443,70 @@ void tegra_channel_ec_close(struct tegra_mc_vi *vi)
 	}
 }
 
+/*
+ * Apply the controls carried by the buffer's request. The sensor latches
+ * them req_latency frames later, which is the frame of this buffer, so
+ * the request is completed right away with the values just written: the
+ * ones that frame is captured with. A reclaimed buffer is re-armed
+ * without applying it again.
+ */
+static void tegra_channel_request_apply(struct tegra_channel *chan,
+	struct tegra_channel_buffer *buf)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	struct media_request *req = buf->buf.vb2_buf.req_obj.req;
+	int err;
+
+	err = v4l2_ctrl_request_setup(req, &chan->ctrl_handler);
+	if (err)
+		dev_warn(chan->vi->dev,
+			"failed to apply request controls for buffer %u: %d\n",
+			buf->buf.vb2_buf.index, err);
+	v4l2_ctrl_request_complete(req, &chan->ctrl_handler);
+#endif
+}
+
+/*
+ * Claim the requests due now, under start_lock. Capture runs req_latency
+ * frames behind the sensor's control latch, so when the buffer of frame
+ * N is armed the request of the buffer that will be armed for frame
+ * N + req_latency is due. Requests that should have gone out earlier,
+ * because the queue ran short, go out late rather than never.
+ * Returns the number of buffers stored in @due, in queue order.
+ */
+static unsigned int tegra_channel_request_due(struct tegra_channel *chan,
+	struct tegra_channel_buffer *buf,
+	struct tegra_channel_buffer **due)
+{
+	struct tegra_channel_buffer *next;
+	unsigned int ahead = min_t(u32, chan->req_latency,
+				TEGRA_REQUEST_LATENCY_MAX);
+	unsigned int num = 0;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	if (buf->buf.vb2_buf.req_obj.req && !buf->req_applied) {
+		buf->req_applied = true;
+		due[num++] = buf;
+	}
+	list_for_each_entry(next, &chan->capture, queue) {
+		if (!ahead--)
+			break;
+		if (!next->buf.vb2_buf.req_obj.req || next->req_applied)
+			continue;
+		next->req_applied = true;
+		due[num++] = next;
+	}
+#endif
+
+	return num;
+}
+
 struct tegra_channel_buffer *dequeue_buffer(struct tegra_channel *chan,
 	bool requeue)
 {
 	struct tegra_channel_buffer *buf = NULL;
+	struct tegra_channel_buffer *due[TEGRA_REQUEST_LATENCY_MAX + 1];
+	unsigned int num_due = 0, i;
 
 	spin_lock(&chan->start_lock);
 	if (list_empty(&chan->capture))
@@ -637,13 +1515,26 @@ struct tegra_channel_buffer *dequeue_buffer(struct tegra_channel *chan,
 	buf = list_entry(chan->capture.next,
 			 struct tegra_channel_buffer, queue);
 	list_del_init(&buf->queue);
+	/* every arming captures a new frame, key its trace events on it */
+	buf->frame_seq = chan->frame_seq++;
+	tegra_channel_emb_attach(chan, buf);
 
 	if (requeue) {
 		/* add dequeued buffer to the ring buffer */
 		add_buffer_to_ring(chan, &buf->buf);
 	}
+	num_due = tegra_channel_request_due(chan, buf, due);
 done:
 	spin_unlock(&chan->start_lock);
+
+	/*
+	 * Control handlers sleep, apply outside the lock. Queued buffers
+	 * only leave the capture list through this thread or after it
+	 * stopped, so the claimed ones stay put meanwhile.
+	 */
+	for (i = 0; i < num_due; i++)
+		tegra_channel_request_apply(chan, due[i]);
+
 	return buf;
 }
 
@@ -665,11 +1556,63 @@ done:
 	return buf;
 }
 
+/* Entries on `list` under `lock` */
+static u32 tegra_channel_list_count(spinlock_t *lock, struct list_head *list)
+{
+	struct list_head *pos;
+	u32 count = 0;
+
+	spin_lock(lock);
+	list_for_each(pos, list)
+		count++;
+	spin_unlock(lock);
+
+	return count;
+}
+
+/*
+ * Frames a channel reset throws away: the buffers armed in the VI and
+ * waiting for their frame, plus the bad entries of the release ring.
+ * Buffers still on the capture queue were never armed and are requeued.
+ */
+static u32 tegra_channel_inflight_lost(struct tegra_channel *chan)
+{
+	return tegra_channel_list_count(&chan->release_lock, &chan->release) +
+		tegra_channel_list_count(&chan->dequeue_lock, &chan->dequeue) +
+		tegra_channel_ring_errors(chan, chan->num_buffers);
+}
+
+/*
+ * Recover the channel after an uncorrectable capture error. The frame
+ * that failed has already been returned as an error by the fops.
+ * The light tier leaves the VI channel and the descriptors armed in it
+ * alone and resumes capture, which costs only that frame. A second
+ * error before a good frame, or a queue error, resets the channel
+ * through the fops. Failed resets are recorded as well.
+ */
 int tegra_channel_error_recover(struct tegra_channel *chan, bool queue_error)
 {
 	struct tegra_mc_vi *vi = chan->vi;
+	ktime_t start = ktime_get();
+	/* the light tier did not stop the errors */
+	bool escalated = chan->recovery_pending;
+	unsigned long flags;
+	u32 lost;
 	int err = 0;
 
+	if (!queue_error && !chan->recovery_pending) {
+		dev_warn(vi->dev, "err_rec: resuming the capture channel\n");
+		spin_lock_irqsave(&chan->capture_state_lock, flags);
+		chan->capture_state = CAPTURE_GOOD;
+		spin_unlock_irqrestore(&chan->capture_state_lock, flags);
+		chan->recovery_pending = true;
+		tegra_channel_record_recovery(chan, TEGRA_RECOVERY_LIGHT,
+			start, 1);
+		return 0;
+	}
+
+	lost = tegra_channel_inflight_lost(chan);
+
 	if (!(vi->fops && vi->fops->vi_error_recover)) {
 		err = -EIO;
 		goto done;
@@ -677,12 +1620,19 @@ int tegra_channel_error_recover(struct tegra_channel *chan, bool queue_error)
 
 	dev_warn(vi->dev, "err_rec: attempting to reset the capture channel\n");
 
+	/* a reset retrains the link from scratch */
+	chan->warm_valid = false;
+
 	err = vi->fops->vi_error_recover(chan, queue_error);
 	if (!err)
 		dev_warn(vi->dev,
 			"err_rec: successfully reset the capture channel\n");
 
 done:
+	tegra_channel_record_recovery(chan, err ? TEGRA_RECOVERY_FAILED :
+		escalated ? TEGRA_RECOVERY_ESCALATED : TEGRA_RECOVERY_FULL,
+		start, lost);
+	chan->recovery_pending = false;
 	return err;
 }
 
@@ -713,6 +1663,12 @@ tegra_channel_queue_setup(struct vb2_queue *vq,
 	struct tegra_channel *chan = vb2_get_drv_priv(vq);
 	struct tegra_mc_vi *vi = chan->vi;
 
+	/* VIDIOC_CREATE_BUFS: validate the requested plane layout */
+	if (*nplanes) {
+		if (*nplanes != 1 || sizes[0] < chan->format.sizeimage)
+			return -EINVAL;
+	}
+
 	*nplanes = 1;
 
 	sizes[0] = chan->format.sizeimage;
@@ -770,7 +1726,9 @@ static int tegra_channel_buffer_prepare(struct vb2_buffer *vb)
 	struct tegra_channel_buffer *buf = to_tegra_channel_buffer(vbuf);
 
 	buf->chan = chan;
-	vb2_set_plane_payload(&vbuf->vb2_buf, 0, chan->format.sizeimage);
+	buf->emb_buf = NULL;
+	buf->req_applied = false;
+	tegra_channel_set_payload(chan, vb);
 #if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
 	buf->addr = vb2_dma_contig_plane_dma_addr(vb, 0);
 #endif
@@ -796,6 +1754,8 @@ static void tegra_channel_buffer_queue(struct vb2_buffer *vb)
 		queue_init_ts = ktime_to_ms(ktime_get());
 	}
 
+	trace_tegra_channel_buf_queue(chan->id, vb->index);
+
 	/* Put buffer into the capture queue */
 	spin_lock(&chan->start_lock);
 	list_add_tail(&buf->queue, &chan->capture);
@@ -806,53 +1766,48 @@ static void tegra_channel_buffer_queue(struct vb2_buffer *vb)
 }
 
 
-static void tegra_channel_queued_buf_done_single_thread(
-		struct tegra_channel *chan,
+/* Return every buffer on `list` to videobuf2 */
+static void tegra_channel_list_buf_done(struct tegra_channel *chan,
+		spinlock_t *lock, struct list_head *list,
 		enum vb2_buffer_state state)
 {
 	struct tegra_channel_buffer *buf, *nbuf;
+	LIST_HEAD(done);
 
-	/* delete capture list */
-	spin_lock(&chan->start_lock);
-	list_for_each_entry_safe(buf, nbuf, &chan->capture, queue) {
+	/* completing a request sleeps, detach the list first */
+	spin_lock(lock);
+	list_splice_init(list, &done);
+	spin_unlock(lock);
+
+	list_for_each_entry_safe(buf, nbuf, &done, queue) {
+		list_del_init(&buf->queue);
+		tegra_channel_buffer_complete(buf, state);
 		vb2_buffer_done(&buf->buf.vb2_buf, state);
-		list_del(&buf->queue);
 	}
-	spin_unlock(&chan->start_lock);
+}
 
+static void tegra_channel_queued_buf_done_single_thread(
+		struct tegra_channel *chan,
+		enum vb2_buffer_state state)
+{
+	/* delete capture list */
+	tegra_channel_list_buf_done(chan, &chan->start_lock, &chan->capture,
+		state);
 	/* delete dequeue list */
-	spin_lock(&chan->dequeue_lock);
-	list_for_each_entry_safe(buf, nbuf, &chan->dequeue, queue) {
-		vb2_buffer_done(&buf->buf.vb2_buf, state);
-		list_del(&buf->queue);
-	}
-	spin_unlock(&chan->dequeue_lock);
+	tegra_channel_list_buf_done(chan, &chan->dequeue_lock, &chan->dequeue,
+		state);
 }
 
 static void tegra_channel_queued_buf_done_multi_thread(
 		struct tegra_channel *chan,
 		enum vb2_buffer_state state)
 {
-	struct tegra_channel_buffer *buf, *nbuf;
-	spinlock_t *lock = &chan->start_lock;
-	spinlock_t *release_lock = &chan->release_lock;
-	struct list_head *q = &chan->capture;
-	struct list_head *rel_q = &chan->release;
-
-	spin_lock(lock);
-	list_for_each_entry_safe(buf, nbuf, q, queue) {
-		vb2_buffer_done(&buf->buf.vb2_buf, state);
-		list_del(&buf->queue);
-	}
-	spin_unlock(lock);
-
+	/* delete capture list */
+	tegra_channel_list_buf_done(chan, &chan->start_lock, &chan->capture,
+		state);
 	/* delete release list */
-	spin_lock(release_lock);
-	list_for_each_entry_safe(buf, nbuf, rel_q, queue) {
-		vb2_buffer_done(&buf->buf.vb2_buf, state);
-		list_del(&buf->queue);
-	}
-	spin_unlock(release_lock);
+	tegra_channel_list_buf_done(chan, &chan->release_lock, &chan->release,
+		state);
 }
 
 /* Return all queued buffers back to videobuf2 */
@@ -893,6 +1848,60 @@ int tegra_channel_write_blobs(struct tegra_channel *chan)
 	return tegracam_write_blobs(s_data->tegracam_ctrl_hdl);
 }
 
+/*
+ * Signature of everything set_stream programs into CSI and the sensor.
+ * A restart with the signature of the last good start can skip deskew
+ * and keep the clock and bandwidth votes.
+ */
+static u32 tegra_channel_stream_signature(struct tegra_channel *chan)
+{
+	struct v4l2_subdev *sd = chan->subdev_on_csi;
+	struct camera_common_data *s_data = sd ?
+		to_camera_common_data(sd->dev) : NULL;
+	u32 sig[] = {
+		chan->format.width,
+		chan->format.height,
+		chan->format.pixelformat,
+		chan->format.bytesperline,
+		chan->fmtinfo->code,
+		chan->gang_mode,
+		chan->valid_ports,
+		chan->numlanes,
+		chan->bypass,
+		chan->pg_mode,
+		s_data ? s_data->mode : 0,
+	};
+
+	return jhash2(sig, ARRAY_SIZE(sig), 0);
+}
+
+static bool tegra_channel_warm_restart(struct tegra_channel *chan)
+{
+	u32 sig = tegra_channel_stream_signature(chan);
+	bool warm = chan->warm_restart && chan->warm_valid &&
+		sig == chan->warm_sig;
+
+	/* the held votes were sized for another configuration */
+	if (!warm && chan->clknbw_held) {
+		tegra_camera_update_clknbw(chan, false);
+		chan->clknbw_held = false;
+	}
+	chan->warm_valid = false;
+	chan->warm_sig = sig;
+
+	return warm;
+}
+
+/* drop the clock and bandwidth votes kept over a stream stop */
+static void tegra_channel_warm_release(struct tegra_channel *chan)
+{
+	chan->warm_valid = false;
+	if (chan->clknbw_held) {
+		tegra_camera_update_clknbw(chan, false);
+		chan->clknbw_held = false;
+	}
+}
+
 int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 {
 	int num_sd;
@@ -900,6 +1909,7 @@ int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 	int err = 0;
 	int max_deskew_attempts = 5;
 	int deskew_attempts = 0;
+	bool deskew, warm;
 	struct v4l2_subdev *sd;
 
 	if (atomic_read(&chan->is_streaming) == on)
@@ -907,7 +1917,13 @@ int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 	trace_tegra_channel_set_stream("enable", on);
 
 	if (on) {
-		tegra_camera_update_clknbw(chan, true);
+		warm = tegra_channel_warm_restart(chan);
+		if (!chan->clknbw_held)
+			tegra_camera_update_clknbw(chan, true);
+		chan->clknbw_held = false;
+		/* lanes deskewed for this configuration stay trained */
+		deskew = !chan->bypass && !chan->pg_mode &&
+			chan->deskew_ctx->deskew_lanes && !warm;
 		/* Enable CSI before sensor. Reason is as follows:
 		 * CSI is able to catch the very first clk transition.
 		 */
@@ -920,8 +1936,7 @@ int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 				if (!ret && err < 0 && err != -ENOIOCTLCMD)
 					ret = err;
 			}
-			if (!chan->bypass && !chan->pg_mode &&
-					chan->deskew_ctx->deskew_lanes) {
+			if (deskew) {
 				err = nvcsi_deskew_apply_check(
 							chan->deskew_ctx);
 				++deskew_attempts;
@@ -942,6 +1957,7 @@ int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 			} else
 				break;
 		}
+		chan->warm_valid = !ret && !(deskew && err);
 	} else {
 		for (num_sd = chan->num_subdevs - 1; num_sd >= 0; num_sd--) {
 			sd = chan->subdev[num_sd];
@@ -953,7 +1969,11 @@ int tegra_channel_set_stream(struct tegra_channel *chan, bool on)
 		}
 		spec_bar();
 
-		tegra_camera_update_clknbw(chan, false);
+		/* keep the votes for a warm restart, close releases them */
+		if (chan->warm_restart && chan->warm_valid)
+			chan->clknbw_held = true;
+		else
+			tegra_camera_update_clknbw(chan, false);
 	}
 
 	if (ret == 0)
@@ -1017,15 +2037,34 @@ static void tegra_channel_stop_streaming(struct vb2_queue *vq)
 		vi->fops->vi_stop_streaming(vq);
 		vi->fops->vi_power_off(chan);
 	}
+	tegra_channel_emb_restore(chan);
 
 	/* Clean-up recorded videobuf2 queue initial timestamp */
 	queue_init_ts = 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+/* request of a buffer cancelled before it was armed for capture */
+static void tegra_channel_buffer_request_complete(struct vb2_buffer *vb)
+{
+	struct tegra_channel *chan = vb2_get_drv_priv(vb->vb2_queue);
+
+	v4l2_ctrl_request_complete(vb->req_obj.req, &chan->ctrl_handler);
+}
+
+static const struct media_device_ops tegra_channel_media_ops = {
+	.req_validate = vb2_request_validate,
+	.req_queue = vb2_request_queue,
+};
+#endif
+
 static const struct vb2_ops tegra_channel_queue_qops = {
 	.queue_setup = tegra_channel_queue_setup,
 	.buf_prepare = tegra_channel_buffer_prepare,
 	.buf_queue = tegra_channel_buffer_queue,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	.buf_request_complete = tegra_channel_buffer_request_complete,
+#endif
 	.wait_prepare = vb2_ops_wait_prepare,
 	.wait_finish = vb2_ops_wait_finish,
 	.start_streaming = tegra_channel_start_streaming,
@@ -1042,8 +2081,9 @@ tegra_channel_querycap(struct file *file, void *fh, struct v4l2_capability *cap)
 	struct tegra_channel *chan = video_drvdata(file);
 	int ret = 0;
 
-	cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
-	cap->device_caps |= V4L2_CAP_EXT_PIX_FORMAT;
+	cap->device_caps = chan->multiplanar ? V4L2_CAP_VIDEO_CAPTURE_MPLANE :
+				V4L2_CAP_VIDEO_CAPTURE;
+	cap->device_caps |= V4L2_CAP_STREAMING | V4L2_CAP_EXT_PIX_FORMAT;
 	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
 
 	strlcpy(cap->driver, "tegra-video", sizeof(cap->driver));
@@ -1064,12 +2104,13 @@ tegra_channel_enum_framesizes(struct file *file, void *fh,
 	struct v4l2_subdev *sd = chan->subdev_on_csi;
 	struct v4l2_subdev_frame_size_enum fse;
 	struct v4l2_subdev_pad_config cfg = {};
-	int ret = 0;
+	int idx, ret = 0;
 
 	/* Convert v4l2 pixel format (fourcc) into media bus format code */
-	fse.code = tegra_core_get_code_by_fourcc(chan, sizes->pixel_format, 0);
-	if (fse.code < 0)
+	idx = tegra_channel_fmt_idx_by_fourcc(chan, sizes->pixel_format);
+	if (idx < 0)
 		return -EINVAL;
+	fse.code = tegra_channel_fmt_code(chan, idx);
 	fse.index = sizes->index;
 	fse.which = V4L2_SUBDEV_FORMAT_ACTIVE;
 	fse.pad = 0;
@@ -1093,13 +2134,13 @@ tegra_channel_enum_frameintervals(struct file *file, void *fh,
 	struct v4l2_subdev *sd = chan->subdev_on_csi;
 	struct v4l2_subdev_frame_interval_enum fie;
 	struct v4l2_subdev_pad_config cfg = {};
-	int ret = 0;
+	int idx, ret = 0;
 
 	/* Convert v4l2 pixel format (fourcc) into media bus format code */
-	fie.code = tegra_core_get_code_by_fourcc(
-		chan, intervals->pixel_format, 0);
-	if (fie.code < 0)
+	idx = tegra_channel_fmt_idx_by_fourcc(chan, intervals->pixel_format);
+	if (idx < 0)
 		return -EINVAL;
+	fie.code = tegra_channel_fmt_code(chan, idx);
 	fie.index = intervals->index;
 	fie.width = intervals->width;
 	fie.height = intervals->height;
@@ -1121,17 +2162,14 @@ static int
 tegra_channel_enum_format(struct file *file, void *fh, struct v4l2_fmtdesc *f)
 {
 	struct tegra_channel *chan = video_drvdata(file);
-	unsigned int index = 0, i;
-	unsigned long *fmts_bitmap = chan->fmts_bitmap;
+	struct tegra_channel_fmt_index *fi = chan->fmt_index;
+	unsigned int index;
 
-	if (f->index >= bitmap_weight(fmts_bitmap, MAX_FORMAT_NUM))
+	if (f->index >= fi->num_enum)
 		return -EINVAL;
 
-	for (i = 0; i < f->index + 1; i++, index++)
-		index = find_next_bit(fmts_bitmap, MAX_FORMAT_NUM, index);
-
-	index -= 1;
-	f->pixelformat = tegra_core_get_fourcc_by_idx(chan, index);
+	index = array_index_nospec(f->index, fi->num_enum);
+	f->pixelformat = fi->enum_fourcc[index];
 
 	return 0;
 }
@@ -1239,13 +2277,82 @@ static int
 tegra_channel_dv_timings_cap(struct file *file, void *fh,
 		struct v4l2_dv_timings_cap *cap)
 {
-	struct tegra_channel *chan = video_drvdata(file);
-	struct v4l2_subdev *sd = chan->subdev_on_csi;
+	struct tegra_channel *chan = video_drvdata(file);
+	struct v4l2_subdev *sd = chan->subdev_on_csi;
+
+	if (!v4l2_subdev_has_op(sd, pad, dv_timings_cap))
+		return -ENOTTY;
+
+	return v4l2_subdev_call(sd, pad, dv_timings_cap, cap);
+}
+
+/* only plain 32-bit values are remembered */
+static bool tegra_channel_ctrl_cacheable(struct v4l2_ctrl *ctrl)
+{
+	return !ctrl->is_ptr && ctrl->type != V4L2_CTRL_TYPE_INTEGER64;
+}
+
+static int tegra_channel_ctrl_cache_find(struct tegra_channel *chan, u32 id)
+{
+	struct tegra_channel_ctrl_cache *cc = chan->ctrl_cache;
+	unsigned int i;
+
+	for (i = 0; i < cc->num; i++)
+		if (cc->entry[i].id == id)
+			return i;
+
+	return -1;
+}
+
+/* called with the control handler lock held */
+static void tegra_channel_ctrl_cache_store(struct tegra_channel *chan,
+	struct v4l2_ctrl *ctrl)
+{
+	struct tegra_channel_ctrl_cache *cc = chan->ctrl_cache;
+	int i;
+
+	if (!cc || !tegra_channel_ctrl_cacheable(ctrl))
+		return;
+
+	i = tegra_channel_ctrl_cache_find(chan, ctrl->id);
+	if (i < 0) {
+		if (cc->num == TEGRA_CTRL_CACHE_SIZE)
+			return;
+		i = cc->num++;
+		cc->entry[i].id = ctrl->id;
+	}
+	cc->entry[i].val = ctrl->val;
+}
+
+/*
+ * Forget every applied value. Channel controls such as OVERRIDE_ENABLE
+ * and GAIN_TPG program the sub-devices, which lose that state when they
+ * are attached anew, so the next handler setup must send them again.
+ */
+static void tegra_channel_ctrl_cache_reset(struct tegra_channel *chan)
+{
+	if (!chan->ctrl_cache)
+		return;
+
+	mutex_lock(chan->ctrl_handler.lock);
+	chan->ctrl_cache->num = 0;
+	mutex_unlock(chan->ctrl_handler.lock);
+}
+
+/* called with the control handler lock held */
+static bool tegra_channel_ctrl_in_effect(struct tegra_channel *chan,
+	struct v4l2_ctrl *ctrl)
+{
+	struct tegra_channel_ctrl_cache *cc = chan->ctrl_cache;
+	int i;
 
-	if (!v4l2_subdev_has_op(sd, pad, dv_timings_cap))
-		return -ENOTTY;
+	if (!cc || !tegra_channel_ctrl_cacheable(ctrl) ||
+			ctrl->type == V4L2_CTRL_TYPE_BUTTON ||
+			ctrl->flags & V4L2_CTRL_FLAG_EXECUTE_ON_WRITE)
+		return false;
 
-	return v4l2_subdev_call(sd, pad, dv_timings_cap, cap);
+	i = tegra_channel_ctrl_cache_find(chan, ctrl->id);
+	return i >= 0 && cc->entry[i].val == ctrl->val;
 }
 
 int tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl)
@@ -1259,6 +2366,10 @@ int tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl)
 		return -EBUSY;
 	}
 
+	/* a rebuilt handler re-applies values that never changed */
+	if (tegra_channel_ctrl_in_effect(chan, ctrl))
+		return 0;
+
 	switch (ctrl->id) {
 	case TEGRA_CAMERA_CID_GAIN_TPG:
 		{
@@ -1326,17 +2437,90 @@ int tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl)
 				&chan->fmtinfo->bpp,
 				chan->preferred_stride);
 		break;
+	case TEGRA_CAMERA_CID_VI_DROP_POLICY:
+		chan->drop_policy = ctrl->val;
+		break;
+	case TEGRA_CAMERA_CID_VI_REQUEST_LATENCY:
+		chan->req_latency = ctrl->val;
+		break;
+	case TEGRA_CAMERA_CID_VI_WARM_RESTART:
+		chan->warm_restart = ctrl->val;
+		if (!chan->warm_restart &&
+				!atomic_read(&chan->is_streaming))
+			tegra_channel_warm_release(chan);
+		break;
+	case TEGRA_CAMERA_CID_VI_GANG_SPLIT:
+		/* buffers are sized for the current split */
+		if (vb2_is_busy(&chan->queue)) {
+			err = -EBUSY;
+			break;
+		}
+		chan->gang_split = ctrl->val;
+		if (chan->total_ports > 1)
+			update_gang_mode(chan);
+		break;
 	default:
 		dev_err(&chan->video->dev, "%s: Invalid ctrl %u\n",
 			__func__, ctrl->id);
 		err = -EINVAL;
 	}
 
+	if (!err)
+		tegra_channel_ctrl_cache_store(chan, ctrl);
+
 	return err;
 }
 
+static int tegra_channel_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct tegra_channel *chan = container_of(ctrl->handler,
+				struct tegra_channel, ctrl_handler);
+
+	switch (ctrl->id) {
+	case TEGRA_CAMERA_CID_VI_DROP_COUNTERS:
+		memcpy(ctrl->p_new.p_u32, chan->drop_count,
+			sizeof(chan->drop_count));
+		break;
+	case TEGRA_CAMERA_CID_VI_DROP_EPISODES:
+		memcpy(ctrl->p_new.p_u32, chan->drop_episodes,
+			sizeof(chan->drop_episodes));
+		break;
+	case TEGRA_CAMERA_CID_VI_RECOVERY_COUNTERS:
+		memcpy(ctrl->p_new.p_u32, chan->recovery_count,
+			sizeof(chan->recovery_count));
+		break;
+	case TEGRA_CAMERA_CID_VI_RECOVERY_TIME_HIST:
+		memcpy(ctrl->p_new.p_u32, chan->recovery_time_hist,
+			sizeof(chan->recovery_time_hist));
+		break;
+	case TEGRA_CAMERA_CID_VI_RECOVERY_LOST_HIST:
+		memcpy(ctrl->p_new.p_u32, chan->recovery_lost_hist,
+			sizeof(chan->recovery_lost_hist));
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_ctrl_ops channel_ctrl_ops = {
 	.s_ctrl	= tegra_channel_s_ctrl,
+	.g_volatile_ctrl = tegra_channel_g_volatile_ctrl,
+};
+
+static const char * const drop_policy_qmenu[] = {
+	[TEGRA_DROP_POLICY_BLOCK] = "Block",
+	[TEGRA_DROP_POLICY_DROP_NEWEST] = "Drop Newest",
+	[TEGRA_DROP_POLICY_DROP_OLDEST] = "Drop Oldest",
+};
+
+static const char * const gang_split_qmenu[] = {
+	[TEGRA_GANG_SPLIT_AUTO] = "Auto",
+	[TEGRA_GANG_SPLIT_L_R] = "Left/Right",
+	[TEGRA_GANG_SPLIT_R_L] = "Right/Left",
+	[TEGRA_GANG_SPLIT_T_B] = "Top/Bottom",
+	[TEGRA_GANG_SPLIT_B_T] = "Bottom/Top",
 };
 
 static const struct v4l2_ctrl_config common_custom_ctrls[] = {
@@ -1471,6 +2655,19 @@ static const struct v4l2_ctrl_config common_custom_ctrls[] = {
 		.dims = { MAX_NUM_SENSOR_MODES,
 			  SENSOR_DV_TIMINGS_CID_SIZE },
 	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_SENSOR_PROPS_BLOB,
+		.name = "Sensor Properties Blob",
+		.type = V4L2_CTRL_TYPE_U8,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY,
+		.min = 0,
+		.max = 0xFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_SENSOR_PROPS_BLOB_MAX_SIZE },
+	},
 	{
 		.ops = &channel_ctrl_ops,
 		.id = TEGRA_CAMERA_CID_LOW_LATENCY,
@@ -1491,6 +2688,118 @@ static const struct v4l2_ctrl_config common_custom_ctrls[] = {
 		.step = 1,
 		.def = 0,
 	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_DROP_POLICY,
+		.name = "Frame Drop Policy",
+		.type = V4L2_CTRL_TYPE_MENU,
+		.def = TEGRA_DROP_POLICY_BLOCK,
+		.min = 0,
+		.max = ARRAY_SIZE(drop_policy_qmenu) - 1,
+		.menu_skip_mask = 0,
+		.qmenu = drop_policy_qmenu,
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_REQUEST_LATENCY,
+		.name = "Request Latency",
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.def = TEGRA_REQUEST_LATENCY_DEF,
+		.min = 0,
+		.max = TEGRA_REQUEST_LATENCY_MAX,
+		.step = 1,
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_WARM_RESTART,
+		.name = "Warm Restart",
+		.type = V4L2_CTRL_TYPE_BOOLEAN,
+		.def = 1,
+		.min = 0,
+		.max = 1,
+		.step = 1,
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_GANG_SPLIT,
+		.name = "Gang Split",
+		.type = V4L2_CTRL_TYPE_MENU,
+		.def = TEGRA_GANG_SPLIT_AUTO,
+		.min = 0,
+		.max = ARRAY_SIZE(gang_split_qmenu) - 1,
+		.menu_skip_mask = 0,
+		.qmenu = gang_split_qmenu,
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_DROP_COUNTERS,
+		.name = "Frame Drop Counters",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY |
+			 V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0,
+		.max = 0xFFFFFFFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_DROP_POLICY_NUM },
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_DROP_EPISODES,
+		.name = "Frame Drop Episodes",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY |
+			 V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0,
+		.max = 0xFFFFFFFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_DROP_POLICY_NUM },
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_RECOVERY_COUNTERS,
+		.name = "Error Recovery Counters",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY |
+			 V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0,
+		.max = 0xFFFFFFFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_RECOVERY_NUM },
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_RECOVERY_TIME_HIST,
+		.name = "Error Recovery Time Histogram",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY |
+			 V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0,
+		.max = 0xFFFFFFFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_RECOVERY_HIST_BUCKETS },
+	},
+	{
+		.ops = &channel_ctrl_ops,
+		.id = TEGRA_CAMERA_CID_VI_RECOVERY_LOST_HIST,
+		.name = "Error Recovery Lost Frames Histogram",
+		.type = V4L2_CTRL_TYPE_U32,
+		.flags = V4L2_CTRL_FLAG_HAS_PAYLOAD |
+			 V4L2_CTRL_FLAG_READ_ONLY |
+			 V4L2_CTRL_FLAG_VOLATILE,
+		.min = 0,
+		.max = 0xFFFFFFFF,
+		.step = 1,
+		.def = 0,
+		.dims = { TEGRA_RECOVERY_HIST_BUCKETS },
+	},
 };
 
 #define GET_TEGRA_CAMERA_CTRL(id, c)					\
@@ -1503,18 +2812,93 @@ do {									\
 	}								\
 } while (0)
 
+/*
+ * Snapshot the sensor mode table into one versioned blob. It is rebuilt
+ * only when the sensor hands over a different mode table.
+ */
+static int tegra_channel_props_blob_build(struct tegra_channel *chan,
+			const struct sensor_properties *props)
+{
+	const struct sensor_mode_properties *modes = props->sensor_modes;
+	struct tegra_sensor_props_blob_hdr *hdr = chan->props_blob;
+	u32 num_modes = min_t(u32, props->num_modes, MAX_NUM_SENSOR_MODES);
+	static const u32 entry_size[TEGRA_SENSOR_PROPS_NUM_SECTIONS] = {
+		[TEGRA_SENSOR_PROPS_SIGNAL] =
+			sizeof(struct sensor_signal_properties),
+		[TEGRA_SENSOR_PROPS_IMAGE] =
+			sizeof(struct sensor_image_properties),
+		[TEGRA_SENSOR_PROPS_CONTROL] =
+			sizeof(struct sensor_control_properties),
+		[TEGRA_SENSOR_PROPS_DV_TIMINGS] =
+			sizeof(struct sensor_dv_timings),
+	};
+	u32 size = sizeof(*hdr);
+	void *blob;
+	u32 i, j;
+
+	if (hdr && chan->props_blob_src == modes &&
+			hdr->num_modes == num_modes)
+		return 0;
+
+	blob = kzalloc(TEGRA_SENSOR_PROPS_BLOB_MAX_SIZE, GFP_KERNEL);
+	if (!blob)
+		return -ENOMEM;
+
+	hdr = blob;
+	hdr->magic = TEGRA_SENSOR_PROPS_BLOB_MAGIC;
+	hdr->version = TEGRA_SENSOR_PROPS_BLOB_VERSION;
+	hdr->num_modes = num_modes;
+	for (j = 0; j < TEGRA_SENSOR_PROPS_NUM_SECTIONS; j++) {
+		hdr->sections[j].offset = size;
+		hdr->sections[j].entry_size = entry_size[j];
+		size += ALIGN(num_modes * entry_size[j], 8);
+	}
+	hdr->size = size;
+
+	for (i = 0; i < num_modes; i++) {
+		const void *src[TEGRA_SENSOR_PROPS_NUM_SECTIONS] = {
+			&modes[i].signal_properties,
+			&modes[i].image_properties,
+			&modes[i].control_properties,
+			&modes[i].dv_timings,
+		};
+
+		for (j = 0; j < TEGRA_SENSOR_PROPS_NUM_SECTIONS; j++)
+			memcpy(blob + hdr->sections[j].offset +
+				i * entry_size[j], src[j], entry_size[j]);
+	}
+	spec_bar();
+
+	kfree(chan->props_blob);
+	chan->props_blob = blob;
+	chan->props_blob_src = modes;
+
+	return 0;
+}
+
+/* serve a read-only array control straight out of the blob */
+static void tegra_channel_props_blob_alias(struct v4l2_ctrl *ctrl,
+			void *data, u32 elems)
+{
+	ctrl->elems = elems;
+	ctrl->p_new.p = data;
+	ctrl->p_cur.p = data;
+}
+
 static int tegra_channel_sensorprops_setup(struct tegra_channel *chan)
 {
 	const struct v4l2_subdev *sd = chan->subdev_on_csi;
 	const struct camera_common_data *s_data =
 			to_camera_common_data(sd->dev);
-	const struct sensor_mode_properties *modes;
+	const struct tegra_sensor_props_blob_hdr *hdr;
 	struct v4l2_ctrl *ctrl_modes;
 	struct v4l2_ctrl *ctrl_signalprops;
 	struct v4l2_ctrl *ctrl_imageprops;
 	struct v4l2_ctrl *ctrl_controlprops;
 	struct v4l2_ctrl *ctrl_dvtimings;
-	u32 i;
+	struct v4l2_ctrl *ctrl_blob;
+	void *blob;
+	int ret;
 
 	if (!s_data)
 		return 0;
@@ -1524,78 +2908,112 @@ static int tegra_channel_sensorprops_setup(struct tegra_channel *chan)
 	GET_TEGRA_CAMERA_CTRL(SENSOR_IMAGE_PROPERTIES, ctrl_imageprops);
 	GET_TEGRA_CAMERA_CTRL(SENSOR_CONTROL_PROPERTIES, ctrl_controlprops);
 	GET_TEGRA_CAMERA_CTRL(SENSOR_DV_TIMINGS, ctrl_dvtimings);
+	GET_TEGRA_CAMERA_CTRL(SENSOR_PROPS_BLOB, ctrl_blob);
 
-	ctrl_modes->val = s_data->sensor_props.num_modes;
-	ctrl_modes->cur.val = s_data->sensor_props.num_modes;
+	ret = tegra_channel_props_blob_build(chan, &s_data->sensor_props);
+	if (ret)
+		return ret;
 
-	/* Update the control sizes
-	 *
-	 * Note that the structs have size elems * sizeof(u32)
-	 * So to get the number of structs (elems * sizeof(u32)) / num_modes
-	 */
-	ctrl_signalprops->elems = s_data->sensor_props.num_modes *
-					SENSOR_SIGNAL_PROPERTIES_CID_SIZE;
+	blob = chan->props_blob;
+	hdr = blob;
 
-	ctrl_imageprops->elems = s_data->sensor_props.num_modes *
-					SENSOR_IMAGE_PROPERTIES_CID_SIZE;
+	ctrl_modes->val = hdr->num_modes;
+	ctrl_modes->cur.val = hdr->num_modes;
 
-	ctrl_controlprops->elems = s_data->sensor_props.num_modes *
-					SENSOR_CONTROL_PROPERTIES_CID_SIZE;
+	/*
+	 * The legacy per-kind controls are views of the blob sections, which
+	 * share their layout: num_modes records of *_CID_SIZE u32 words.
+	 */
+	tegra_channel_props_blob_alias(ctrl_signalprops,
+		blob + hdr->sections[TEGRA_SENSOR_PROPS_SIGNAL].offset,
+		hdr->num_modes * SENSOR_SIGNAL_PROPERTIES_CID_SIZE);
+	tegra_channel_props_blob_alias(ctrl_imageprops,
+		blob + hdr->sections[TEGRA_SENSOR_PROPS_IMAGE].offset,
+		hdr->num_modes * SENSOR_IMAGE_PROPERTIES_CID_SIZE);
+	tegra_channel_props_blob_alias(ctrl_controlprops,
+		blob + hdr->sections[TEGRA_SENSOR_PROPS_CONTROL].offset,
+		hdr->num_modes * SENSOR_CONTROL_PROPERTIES_CID_SIZE);
+	tegra_channel_props_blob_alias(ctrl_dvtimings,
+		blob + hdr->sections[TEGRA_SENSOR_PROPS_DV_TIMINGS].offset,
+		hdr->num_modes * SENSOR_DV_TIMINGS_CID_SIZE);
+	tegra_channel_props_blob_alias(ctrl_blob, blob, hdr->size);
 
-	ctrl_dvtimings->elems = s_data->sensor_props.num_modes *
-					SENSOR_DV_TIMINGS_CID_SIZE;
+	return 0;
+}
 
-	modes = s_data->sensor_props.sensor_modes;
-	for (i = 0; i < s_data->sensor_props.num_modes; i++) {
-		void *ptr = NULL;
-		u32 size;
+static bool tegra_channel_ctrl_hdl_merged(struct tegra_channel *chan,
+	struct v4l2_ctrl_handler *hdl)
+{
+	int i;
 
-		size = sizeof(struct sensor_signal_properties);
-		ptr = ctrl_signalprops->p_new.p + (i * size);
-		memcpy(ptr, &modes[i].signal_properties, size);
+	for (i = 0; i < MAX_SUBDEVICES; i++)
+		if (chan->ctrl_hdls[i] == hdl)
+			return true;
 
-		size = sizeof(struct sensor_image_properties);
-		ptr = ctrl_imageprops->p_new.p + (i * size);
-		memcpy(ptr, &modes[i].image_properties, size);
+	return false;
+}
 
-		size = sizeof(struct sensor_control_properties);
-		ptr = ctrl_controlprops->p_new.p + (i * size);
-		memcpy(ptr, &modes[i].control_properties, size);
+/*
+ * Take the controls of a merged sub-device handler back out of the
+ * channel handler. The control framework has no call for it, so the
+ * references are unlinked the way v4l2_ctrl_handler_free() drops them.
+ * The controls themselves belong to the sub-device handler.
+ */
+static void tegra_channel_ctrl_unmerge(struct tegra_channel *chan,
+	struct v4l2_ctrl_handler *hdl)
+{
+	struct v4l2_ctrl_handler *chdl = &chan->ctrl_handler;
+	struct v4l2_ctrl_ref *ref, *next_ref, **pref;
 
-		size = sizeof(struct sensor_dv_timings);
-		ptr = ctrl_dvtimings->p_new.p + (i * size);
-		memcpy(ptr, &modes[i].dv_timings, size);
+	mutex_lock(chdl->lock);
+	list_for_each_entry_safe(ref, next_ref, &chdl->ctrl_refs, node) {
+		if (ref->ctrl->handler != hdl)
+			continue;
+		pref = &chdl->buckets[ref->ctrl->id % chdl->nr_of_buckets];
+		while (*pref != ref)
+			pref = &(*pref)->next;
+		*pref = ref->next;
+		list_del(&ref->node);
+		if (chdl->cached == ref)
+			chdl->cached = NULL;
+		kfree(ref);
 	}
-	spec_bar();
+	mutex_unlock(chdl->lock);
+}
 
-	/* Do not copy memory into p_cur block, reuse p_new */
-	ctrl_signalprops->p_cur.p = ctrl_signalprops->p_new.p;
-	ctrl_imageprops->p_cur.p = ctrl_imageprops->p_new.p;
-	ctrl_controlprops->p_cur.p = ctrl_controlprops->p_new.p;
-	ctrl_dvtimings->p_cur.p = ctrl_dvtimings->p_new.p;
+/* unmerge the sub-device handlers that are no longer on the channel */
+static void tegra_channel_del_subdev_ctrls(struct tegra_channel *chan)
+{
+	int i, num_sd;
 
-	return 0;
+	for (i = 0; i < MAX_SUBDEVICES; i++) {
+		if (!chan->ctrl_hdls[i])
+			continue;
+		for (num_sd = 0; num_sd < chan->num_subdevs; num_sd++)
+			if (chan->subdev[num_sd]->ctrl_handler ==
+					chan->ctrl_hdls[i])
+				break;
+		if (num_sd < chan->num_subdevs)
+			continue;
+		tegra_channel_ctrl_unmerge(chan, chan->ctrl_hdls[i]);
+		chan->ctrl_hdls[i] = NULL;
+	}
 }
 
-static int tegra_channel_setup_controls(struct tegra_channel *chan)
+static int tegra_channel_add_subdev_ctrls(struct tegra_channel *chan)
 {
-	int num_sd = 0;
-	struct v4l2_subdev *sd = NULL;
-	struct tegra_mc_vi *vi = chan->vi;
-	struct v4l2_ctrl *ctrl;
-	int i;
+	struct v4l2_subdev *sd;
+	int num_sd, i;
 	int ret = 0;
 
-	/* Clear and reinit control handler - Bug 1956853 */
-	v4l2_ctrl_handler_free(&chan->ctrl_handler);
-	v4l2_ctrl_handler_init(&chan->ctrl_handler, MAX_CID_CONTROLS);
+	for (num_sd = 0; num_sd < chan->num_subdevs; num_sd++) {
+		sd = chan->subdev[num_sd];
+		if (!sd || !sd->ctrl_handler ||
+				tegra_channel_ctrl_hdl_merged(chan,
+					sd->ctrl_handler))
+			continue;
 
-	/* Initialize the subdev and controls here at first open */
-	sd = chan->subdev[num_sd];
-	while ((sd = chan->subdev[num_sd++]) &&
-		(num_sd <= chan->num_subdevs)) {
 		/* Add control handler for the subdevice */
-
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0)
 		ret = v4l2_ctrl_add_handler(&chan->ctrl_handler,
 					sd->ctrl_handler, NULL);
@@ -1603,11 +3021,53 @@ static int tegra_channel_setup_controls(struct tegra_channel *chan)
 		ret = v4l2_ctrl_add_handler(&chan->ctrl_handler,
 					sd->ctrl_handler, NULL, false);
 #endif
-		if (ret || chan->ctrl_handler.error)
+		if (ret || chan->ctrl_handler.error) {
 			dev_err(chan->vi->dev,
 				"Failed to add sub-device controls\n");
+			continue;
+		}
+
+		for (i = 0; i < MAX_SUBDEVICES; i++) {
+			if (!chan->ctrl_hdls[i]) {
+				chan->ctrl_hdls[i] = sd->ctrl_handler;
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int tegra_channel_setup_controls(struct tegra_channel *chan)
+{
+	struct tegra_mc_vi *vi = chan->vi;
+	struct v4l2_ctrl *ctrl;
+	int i;
+	int ret = 0;
+
+	/*
+	 * With the channel controls in place only the sub-device handlers
+	 * change: the ones that went away are unmerged and the ones newly
+	 * bound merged, nothing changes for the rest.
+	 */
+	if (chan->ctrls_built) {
+		tegra_channel_del_subdev_ctrls(chan);
+		ret = tegra_channel_add_subdev_ctrls(chan);
+		if (ret < 0)
+			return ret;
+		/* resends whatever a sub-device change invalidated */
+		return v4l2_ctrl_handler_setup(&chan->ctrl_handler);
 	}
 
+	/* Clear and reinit control handler - Bug 1956853 */
+	chan->ctrls_built = false;
+	v4l2_ctrl_handler_free(&chan->ctrl_handler);
+	v4l2_ctrl_handler_init(&chan->ctrl_handler, MAX_CID_CONTROLS);
+	memset(chan->ctrl_hdls, 0, sizeof(chan->ctrl_hdls));
+
+	/* Initialize the subdev and controls here at first open */
+	tegra_channel_add_subdev_ctrls(chan);
+
 	/* Add new custom controls */
 	for (i = 0; i < ARRAY_SIZE(common_custom_ctrls); i++) {
 		switch (common_custom_ctrls[i].id) {
@@ -1649,7 +3109,8 @@ static int tegra_channel_setup_controls(struct tegra_channel *chan)
 		 * This should keep accesses to only the modes
 		 * later defined in the DT
 		 */
-		if (ctrl->is_array)
+		if (ctrl->is_array &&
+			!(ctrl->flags & V4L2_CTRL_FLAG_VOLATILE))
 			ctrl->elems = 0;
 	}
 
@@ -1669,15 +3130,21 @@ static int tegra_channel_setup_controls(struct tegra_channel *chan)
 				"Failed to add VI controls\n");
 	}
 
-	/* setup the controls */
+	/*
+	 * Setup the controls, tegra_channel_s_ctrl() skips the ones whose
+	 * value is already in effect. Sub-device controls are left alone,
+	 * each sub-device syncs its own hardware when it starts streaming.
+	 */
 	ret = v4l2_ctrl_handler_setup(&chan->ctrl_handler);
 	if (ret < 0)
 		goto error;
 
+	chan->ctrls_built = true;
 	return 0;
 
 error:
 	v4l2_ctrl_handler_free(&chan->ctrl_handler);
+	memset(chan->ctrl_hdls, 0, sizeof(chan->ctrl_hdls));
 	return ret;
 }
 
@@ -1894,14 +3361,45 @@ static void tegra_channel_populate_dev_info(struct tegra_camera_dev_info *cdev,
 	cdev->bw /= 8;
 }
 
+static int tegra_channel_emb_register(struct tegra_channel *chan);
+static void tegra_channel_emb_unregister(struct tegra_channel *chan);
+
 void tegra_channel_remove_subdevices(struct tegra_channel *chan)
 {
+	tegra_channel_emb_unregister(chan);
 	tegra_channel_free_sensor_properties(chan->subdev_on_csi);
 	video_unregister_device(chan->video);
 	chan->video = NULL;
 	chan->num_subdevs = 0;
 	chan->subdev_on_csi = NULL;
+	tegra_channel_try_cache_invalidate(chan);
+	/* the handler is re-initialized with the next video node */
+	chan->ctrls_built = false;
+	memset(chan->ctrl_hdls, 0, sizeof(chan->ctrl_hdls));
+}
+
+/*
+ * Drop the channel's references to its sub-devices while keeping the
+ * video and metadata nodes registered, so that a sub-device can unbind
+ * and bind again underneath an idle channel. tegra_channel_init_subdevices()
+ * re-attaches them.
+ */
+void tegra_channel_detach_subdevices(struct tegra_channel *chan)
+{
+	tegra_channel_free_sensor_properties(chan->subdev_on_csi);
+	tegra_camera_device_unregister(chan);
+	memset(chan->subdev, 0, sizeof(chan->subdev));
+	chan->num_subdevs = 0;
+	chan->subdev_on_csi = NULL;
+	tegra_channel_try_cache_invalidate(chan);
+	tegra_channel_ctrl_cache_reset(chan);
+
+	/* unmerge the sub-device controls */
+	if (chan->video && tegra_channel_setup_controls(chan) < 0)
+		dev_err(chan->vi->dev, "%s: failed to reset controls\n",
+			__func__);
 }
+EXPORT_SYMBOL(tegra_channel_detach_subdevices);
 
 int tegra_channel_init_subdevices(struct tegra_channel *chan)
 {
@@ -1971,6 +3469,10 @@ int tegra_channel_init_subdevices(struct tegra_channel *chan)
 	 * Mark that subdev as subdev_on_csi
 	 */
 	chan->subdev_on_csi = sd;
+	/* results negotiated against the previous sensor are stale */
+	tegra_channel_try_cache_invalidate(chan);
+	/* and the channel controls have to reach the new one */
+	tegra_channel_ctrl_cache_reset(chan);
 
 	/* initialize the available formats */
 	if (chan->num_subdevs)
@@ -2011,6 +3513,11 @@ int tegra_channel_init_subdevices(struct tegra_channel *chan)
 		goto fail;
 	}
 
+	ret = tegra_channel_emb_register(chan);
+	if (ret < 0)
+		dev_warn(chan->vi->dev,
+			"%s: embedded data node unavailable\n", __func__);
+
 	tegra_channel_populate_dev_info(&camdev_info, chan);
 	ret = tegra_camera_device_register(&camdev_info, chan);
 
@@ -2019,6 +3526,7 @@ fail:
 	tegra_channel_free_sensor_properties(chan->subdev_on_csi);
 	return ret;
 }
+EXPORT_SYMBOL(tegra_channel_init_subdevices);
 
 struct v4l2_subdev *tegra_channel_find_linked_csi_subdev(
 	struct tegra_channel *chan)
@@ -2036,16 +3544,116 @@ struct v4l2_subdev *tegra_channel_find_linked_csi_subdev(
 	return NULL;
 }
 
-static int
-tegra_channel_get_format(struct file *file, void *fh,
-			struct v4l2_format *format)
+static int
+tegra_channel_get_format(struct file *file, void *fh,
+			struct v4l2_format *format)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+	struct v4l2_pix_format *pix = &format->fmt.pix;
+
+	*pix = chan->format;
+
+	return 0;
+}
+
+static int tegra_channel_try_cache_init(struct tegra_channel *chan)
+{
+	struct tegra_channel_try_cache *tc;
+
+	tc = devm_kzalloc(chan->vi->dev, sizeof(*tc), GFP_KERNEL);
+	if (!tc)
+		return -ENOMEM;
+
+	spin_lock_init(&tc->lock);
+	tc->generation = 1;
+	chan->try_cache = tc;
+
+	return 0;
+}
+
+static void tegra_channel_try_cache_key(struct tegra_channel *chan,
+			const struct v4l2_pix_format *pix,
+			struct tegra_channel_try_key *key)
+{
+	struct v4l2_subdev_format fmt = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.pad = 0,
+	};
+	struct v4l2_subdev_pad_config cfg = {};
+	struct v4l2_ctrl *mode_ctrl;
+
+	memset(key, 0, sizeof(*key));
+	key->pixelformat = pix->pixelformat;
+	key->width = pix->width;
+	key->height = pix->height;
+	key->bytesperline = pix->bytesperline;
+	key->field = pix->field;
+	key->colorspace = pix->colorspace;
+	key->ycbcr_enc = pix->ycbcr_enc;
+	key->quantization = pix->quantization;
+	key->xfer_func = pix->xfer_func;
+	key->width_align = chan->width_align;
+	key->height_align = chan->height_align;
+	key->stride_align = chan->stride_align;
+	key->size_align = chan->size_align;
+	key->active_fourcc = chan->fmtinfo->fourcc;
+	key->pg_mode = chan->pg_mode;
+
+	if (!v4l2_subdev_call(chan->subdev_on_csi, pad, get_fmt, &cfg, &fmt)) {
+		key->sd_code = fmt.format.code;
+		key->sd_width = fmt.format.width;
+		key->sd_height = fmt.format.height;
+	}
+	mode_ctrl = v4l2_ctrl_find(&chan->ctrl_handler,
+			TEGRA_CAMERA_CID_SENSOR_MODE_ID);
+	/* the sensor mode control is a 64-bit integer */
+	key->sd_mode_id = mode_ctrl ? v4l2_ctrl_g_ctrl_int64(mode_ctrl) : -1;
+}
+
+static bool tegra_channel_try_cache_lookup(struct tegra_channel *chan,
+			struct tegra_channel_try_key *key,
+			struct v4l2_pix_format *pix)
+{
+	struct tegra_channel_try_cache *tc = chan->try_cache;
+	unsigned long flags;
+	bool hit = false;
+	u32 priv = pix->priv;
+	u32 pix_flags = pix->flags;
+	int i;
+
+	spin_lock_irqsave(&tc->lock, flags);
+	key->generation = tc->generation;
+	for (i = 0; i < TEGRA_TRY_CACHE_ENTRIES; i++) {
+		if (memcmp(&tc->entry[i].key, key, sizeof(*key)))
+			continue;
+		*pix = tc->entry[i].pix;
+		hit = true;
+		break;
+	}
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	/* fields the negotiation never touches stay the caller's */
+	pix->priv = priv;
+	pix->flags = pix_flags;
+
+	return hit;
+}
+
+static void tegra_channel_try_cache_store(struct tegra_channel *chan,
+			const struct tegra_channel_try_key *key,
+			const struct v4l2_pix_format *pix)
 {
-	struct tegra_channel *chan = video_drvdata(file);
-	struct v4l2_pix_format *pix = &format->fmt.pix;
-
-	*pix = chan->format;
-
-	return 0;
+	struct tegra_channel_try_cache *tc = chan->try_cache;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tc->lock, flags);
+	/* drop results negotiated against a stale configuration */
+	if (key->generation == tc->generation) {
+		tc->entry[tc->next].key = *key;
+		tc->entry[tc->next].pix = *pix;
+		tc->next = (tc->next + 1) % TEGRA_TRY_CACHE_ENTRIES;
+	}
+	spin_unlock_irqrestore(&tc->lock, flags);
 }
 
 static int
@@ -2056,13 +3664,19 @@ __tegra_channel_try_format(struct tegra_channel *chan,
 	struct v4l2_subdev_format fmt;
 	struct v4l2_subdev *sd = chan->subdev_on_csi;
 	struct v4l2_subdev_pad_config cfg = {};
+	struct tegra_channel_try_key key;
+	u32 bricks;
 	int ret = 0;
 
+	tegra_channel_try_cache_key(chan, pix, &key);
+	if (tegra_channel_try_cache_lookup(chan, &key, pix))
+		return 0;
+
 	/* Use the channel format if pixformat is not supported */
-	vfmt = tegra_core_get_format_by_fourcc(chan, pix->pixelformat);
+	vfmt = tegra_channel_format_by_fourcc(chan, pix->pixelformat);
 	if (!vfmt) {
 		pix->pixelformat = chan->format.pixelformat;
-		vfmt = tegra_core_get_format_by_fourcc(chan, pix->pixelformat);
+		vfmt = tegra_channel_format_by_fourcc(chan, pix->pixelformat);
 		if (!vfmt)
 			return -EINVAL;
 	}
@@ -2075,6 +3689,18 @@ __tegra_channel_try_format(struct tegra_channel *chan,
 	if (ret == -ENOIOCTLCMD)
 		return -ENOTTY;
 
+	/* a mode the channel's CSI bricks cannot carry does not stream */
+	bricks = tegra_channel_mode_bricks(chan, fmt.format.width,
+			fmt.format.height, vfmt);
+	if (!ret && !chan->pg_mode &&
+			bricks > max_t(u32, chan->total_ports, 1)) {
+		dev_dbg(chan->vi->dev,
+			"%ux%u needs %u CSI bricks, channel has %u\n",
+			fmt.format.width, fmt.format.height, bricks,
+			chan->total_ports);
+		return -EINVAL;
+	}
+
 	v4l2_fill_pix_format(pix, &fmt.format);
 
 	tegra_channel_fmt_align(chan, vfmt,
@@ -2084,6 +3710,9 @@ __tegra_channel_try_format(struct tegra_channel *chan,
 	if (chan->fmtinfo->fourcc == V4L2_PIX_FMT_NV16)
 		pix->sizeimage *= 2;
 
+	if (!ret)
+		tegra_channel_try_cache_store(chan, &key, pix);
+
 	return ret;
 }
 
@@ -2106,7 +3735,7 @@ __tegra_channel_set_format(struct tegra_channel *chan,
 	struct v4l2_subdev_pad_config cfg = {};
 	int ret = 0;
 
-	vfmt = tegra_core_get_format_by_fourcc(chan, pix->pixelformat);
+	vfmt = tegra_channel_format_by_fourcc(chan, pix->pixelformat);
 	if (!vfmt)
 		return -EINVAL;
 
@@ -2118,6 +3747,9 @@ __tegra_channel_set_format(struct tegra_channel *chan,
 	if (ret == -ENOIOCTLCMD)
 		return -ENOTTY;
 
+	/* the sensor may bound TRY negotiation by its active mode */
+	tegra_channel_try_cache_invalidate(chan);
+
 	v4l2_fill_pix_format(pix, &fmt.format);
 	if (!ret) {
 		chan->format = *pix;
@@ -2157,6 +3789,60 @@ tegra_channel_set_format(struct file *file, void *fh,
 	return __tegra_channel_set_format(chan, &format->fmt.pix);
 }
 
+static int
+tegra_channel_get_format_mplane(struct file *file, void *fh,
+			struct v4l2_format *format)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+
+	tegra_channel_pix_to_mplane(&chan->format, &format->fmt.pix_mp);
+
+	return 0;
+}
+
+static int
+tegra_channel_try_format_mplane(struct file *file, void *fh,
+			struct v4l2_format *format)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+	struct v4l2_pix_format pix;
+	int ret;
+
+	tegra_channel_mplane_to_pix(&format->fmt.pix_mp, &pix);
+	ret = __tegra_channel_try_format(chan, &pix);
+	if (ret)
+		return ret;
+
+	tegra_channel_pix_to_mplane(&pix, &format->fmt.pix_mp);
+
+	return 0;
+}
+
+static int
+tegra_channel_set_format_mplane(struct file *file, void *fh,
+			struct v4l2_format *format)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+	struct v4l2_pix_format pix;
+	int ret;
+
+	tegra_channel_mplane_to_pix(&format->fmt.pix_mp, &pix);
+	ret = __tegra_channel_try_format(chan, &pix);
+	if (ret)
+		return ret;
+
+	if (vb2_is_busy(&chan->queue))
+		return -EBUSY;
+
+	ret = __tegra_channel_set_format(chan, &pix);
+	if (ret)
+		return ret;
+
+	tegra_channel_pix_to_mplane(&pix, &format->fmt.pix_mp);
+
+	return 0;
+}
+
 static int tegra_channel_subscribe_event(struct v4l2_fh *fh,
 				  const struct v4l2_event_subscription *sub)
 {
@@ -2270,6 +3956,10 @@ static const struct v4l2_ioctl_ops tegra_channel_ioctl_ops = {
 	.vidioc_g_fmt_vid_cap		= tegra_channel_get_format,
 	.vidioc_s_fmt_vid_cap		= tegra_channel_set_format,
 	.vidioc_try_fmt_vid_cap		= tegra_channel_try_format,
+	.vidioc_enum_fmt_vid_cap_mplane	= tegra_channel_enum_format,
+	.vidioc_g_fmt_vid_cap_mplane	= tegra_channel_get_format_mplane,
+	.vidioc_s_fmt_vid_cap_mplane	= tegra_channel_set_format_mplane,
+	.vidioc_try_fmt_vid_cap_mplane	= tegra_channel_try_format_mplane,
 	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
 	.vidioc_prepare_buf		= vb2_ioctl_prepare_buf,
 	.vidioc_querybuf		= vb2_ioctl_querybuf,
@@ -2362,6 +4052,8 @@ static int tegra_channel_close(struct file *fp)
 			dev_err(vi->dev, "Failed to power off subdevices\n");
 	}
 
+	tegra_channel_warm_release(chan);
+
 	mutex_unlock(&chan->video_lock);
 	return ret;
 }
@@ -2386,6 +4078,270 @@ static const struct v4l2_file_operations tegra_channel_fops = {
 	.mmap		= vb2_fop_mmap,
 };
 
+/* -----------------------------------------------------------------------------
+ * Embedded data metadata node
+ */
+static int
+tegra_channel_emb_queue_setup(struct vb2_queue *vq,
+		     unsigned int *nbuffers, unsigned int *nplanes,
+		     unsigned int sizes[], struct device *alloc_devs[])
+{
+	struct tegra_channel *chan = vb2_get_drv_priv(vq);
+	u32 size = tegra_channel_emb_size(chan);
+
+	/* Sensor mode does not carry embedded data lines */
+	if (!size)
+		return -EINVAL;
+
+	if (*nplanes)
+		return sizes[0] < size ? -EINVAL : 0;
+
+	*nplanes = 1;
+	sizes[0] = size;
+	alloc_devs[0] = tegra_channel_get_vi_unit(chan);
+
+	return 0;
+}
+
+static int tegra_channel_emb_buffer_prepare(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct tegra_channel *chan = vb2_get_drv_priv(vb->vb2_queue);
+	struct tegra_channel_buffer *buf = to_tegra_channel_buffer(vbuf);
+
+	if (vb2_plane_size(vb, 0) < tegra_channel_emb_size(chan))
+		return -EINVAL;
+
+	buf->chan = chan;
+	buf->emb_buf = NULL;
+	vb2_set_plane_payload(vb, 0, tegra_channel_emb_size(chan));
+#if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
+	buf->addr = vb2_dma_contig_plane_dma_addr(vb, 0);
+#endif
+
+	return 0;
+}
+
+static void tegra_channel_emb_buffer_queue(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct tegra_channel *chan = vb2_get_drv_priv(vb->vb2_queue);
+	struct tegra_channel_buffer *buf = to_tegra_channel_buffer(vbuf);
+
+	spin_lock(&chan->emb_lock);
+	list_add_tail(&buf->queue, &chan->emb_capture);
+	spin_unlock(&chan->emb_lock);
+}
+
+static int tegra_channel_emb_start_streaming(struct vb2_queue *vq, u32 count)
+{
+	return 0;
+}
+
+static void tegra_channel_emb_stop_streaming(struct vb2_queue *vq)
+{
+	struct tegra_channel *chan = vb2_get_drv_priv(vq);
+	struct tegra_channel_buffer *buf, *nbuf;
+	bool drained;
+
+	/* nothing is lent to the VI any more after this */
+	spin_lock(&chan->emb_lock);
+	list_for_each_entry_safe(buf, nbuf, &chan->emb_capture, queue) {
+		list_del_init(&buf->queue);
+		vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock(&chan->emb_lock);
+
+	/*
+	 * Active buffers are programmed into descriptors the VI may still
+	 * write. They come back with their frame, or all at once when the
+	 * video queue stops and cancels the capture.
+	 */
+	drained = wait_event_timeout(chan->emb_wait,
+			list_empty_careful(&chan->emb_active),
+			msecs_to_jiffies(TEGRA_EMB_STOP_TIMEOUT_MS));
+	if (drained)
+		return;
+
+	/* no frame completed for that long, the VI is not writing them */
+	dev_warn(chan->vi->dev, "%s: metadata buffers stuck in flight\n",
+		chan->emb_video->name);
+	spin_lock(&chan->emb_lock);
+	list_for_each_entry_safe(buf, nbuf, &chan->emb_active, queue) {
+		buf->emb_buf->emb_buf = NULL;
+		buf->emb_buf = NULL;
+		list_del_init(&buf->queue);
+		vb2_buffer_done(&buf->buf.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock(&chan->emb_lock);
+}
+
+static const struct vb2_ops tegra_channel_emb_qops = {
+	.queue_setup = tegra_channel_emb_queue_setup,
+	.buf_prepare = tegra_channel_emb_buffer_prepare,
+	.buf_queue = tegra_channel_emb_buffer_queue,
+	.wait_prepare = vb2_ops_wait_prepare,
+	.wait_finish = vb2_ops_wait_finish,
+	.start_streaming = tegra_channel_emb_start_streaming,
+	.stop_streaming = tegra_channel_emb_stop_streaming,
+};
+
+static int
+tegra_channel_emb_querycap(struct file *file, void *fh,
+			struct v4l2_capability *cap)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+	int ret = 0;
+
+	cap->device_caps = V4L2_CAP_META_CAPTURE | V4L2_CAP_STREAMING;
+	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+
+	strlcpy(cap->driver, "tegra-video", sizeof(cap->driver));
+	strlcpy(cap->card, chan->emb_video->name, sizeof(cap->card));
+	ret = snprintf(cap->bus_info, sizeof(cap->bus_info), "platform:%s:%u",
+		 dev_name(chan->vi->dev), chan->port[0]);
+	if (ret < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int
+tegra_channel_emb_enum_format(struct file *file, void *fh,
+			struct v4l2_fmtdesc *f)
+{
+	if (f->index > 0)
+		return -EINVAL;
+
+	f->pixelformat = TEGRA_META_FMT_EMB_DATA;
+
+	return 0;
+}
+
+static int
+tegra_channel_emb_get_format(struct file *file, void *fh,
+			struct v4l2_format *format)
+{
+	struct tegra_channel *chan = video_drvdata(file);
+	struct v4l2_meta_format *meta = &format->fmt.meta;
+
+	meta->dataformat = TEGRA_META_FMT_EMB_DATA;
+	meta->buffersize = tegra_channel_emb_size(chan);
+
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops tegra_channel_emb_ioctl_ops = {
+	.vidioc_querycap		= tegra_channel_emb_querycap,
+	.vidioc_enum_fmt_meta_cap	= tegra_channel_emb_enum_format,
+	.vidioc_g_fmt_meta_cap		= tegra_channel_emb_get_format,
+	.vidioc_s_fmt_meta_cap		= tegra_channel_emb_get_format,
+	.vidioc_try_fmt_meta_cap	= tegra_channel_emb_get_format,
+	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
+	.vidioc_querybuf		= vb2_ioctl_querybuf,
+	.vidioc_qbuf			= vb2_ioctl_qbuf,
+	.vidioc_dqbuf			= vb2_ioctl_dqbuf,
+	.vidioc_create_bufs		= vb2_ioctl_create_bufs,
+	.vidioc_expbuf			= vb2_ioctl_expbuf,
+	.vidioc_streamon		= vb2_ioctl_streamon,
+	.vidioc_streamoff		= vb2_ioctl_streamoff,
+};
+
+static const struct v4l2_file_operations tegra_channel_emb_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= video_ioctl2,
+	.open		= v4l2_fh_open,
+	.release	= vb2_fop_release,
+	.poll		= vb2_fop_poll,
+	.mmap		= vb2_fop_mmap,
+};
+
+static int tegra_channel_emb_queue_init(struct tegra_channel *chan)
+{
+	INIT_LIST_HEAD(&chan->emb_capture);
+	INIT_LIST_HEAD(&chan->emb_active);
+	init_waitqueue_head(&chan->emb_wait);
+	chan->emb_scratch = 0;
+	spin_lock_init(&chan->emb_lock);
+	mutex_init(&chan->emb_video_lock);
+
+	chan->emb_queue.type = V4L2_BUF_TYPE_META_CAPTURE;
+	chan->emb_queue.io_modes = VB2_MMAP | VB2_DMABUF;
+	chan->emb_queue.lock = &chan->emb_video_lock;
+	chan->emb_queue.drv_priv = chan;
+	chan->emb_queue.buf_struct_size = sizeof(struct tegra_channel_buffer);
+	chan->emb_queue.ops = &tegra_channel_emb_qops;
+#if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
+	chan->emb_queue.mem_ops = &vb2_dma_contig_memops;
+#endif
+	chan->emb_queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+				   | V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
+
+	return vb2_queue_init(&chan->emb_queue);
+}
+
+static int tegra_channel_emb_register(struct tegra_channel *chan)
+{
+	int ret, len;
+
+	/* TPG does not produce embedded data */
+	if (chan->pg_mode || chan->emb_video)
+		return 0;
+	/* the VI could not deliver it per frame */
+	if (!tegra_channel_emb_per_frame(chan))
+		return 0;
+
+	chan->emb_video = video_device_alloc();
+	if (!chan->emb_video)
+		return -ENOMEM;
+
+	chan->emb_video->fops = &tegra_channel_emb_fops;
+	chan->emb_video->ioctl_ops = &tegra_channel_emb_ioctl_ops;
+	chan->emb_video->v4l2_dev = &chan->vi->v4l2_dev;
+	chan->emb_video->queue = &chan->emb_queue;
+	chan->emb_video->lock = &chan->emb_video_lock;
+	chan->emb_video->release = video_device_release;
+	chan->emb_video->vfl_dir = VFL_DIR_RX;
+	chan->emb_video->device_caps = V4L2_CAP_META_CAPTURE |
+					V4L2_CAP_STREAMING;
+	len = snprintf(chan->emb_video->name, sizeof(chan->emb_video->name),
+		"%s-emb-%u", dev_name(chan->vi->dev), chan->port[0]);
+	if (len < 0) {
+		ret = -EINVAL;
+		goto error;
+	}
+
+	video_set_drvdata(chan->emb_video, chan);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0)
+	ret = video_register_device(chan->emb_video, VFL_TYPE_GRABBER, -1);
+#else
+	ret = video_register_device(chan->emb_video, VFL_TYPE_VIDEO, -1);
+#endif
+	if (ret < 0) {
+		dev_err(chan->vi->dev, "failed to register %s\n",
+			chan->emb_video->name);
+		goto error;
+	}
+
+	return 0;
+
+error:
+	video_device_release(chan->emb_video);
+	chan->emb_video = NULL;
+	return ret;
+}
+
+static void tegra_channel_emb_unregister(struct tegra_channel *chan)
+{
+	if (!chan->emb_video)
+		return;
+
+	/* release callback frees the video_device */
+	video_unregister_device(chan->emb_video);
+	chan->emb_video = NULL;
+}
+
 static int tegra_channel_csi_init(struct tegra_channel *chan)
 {
 	int idx = 0;
@@ -2452,6 +4408,7 @@ int tegra_channel_init_video(struct tegra_channel *chan)
 	}
 
 	/* init control handler */
+	chan->ctrls_built = false;
 	ret = v4l2_ctrl_handler_init(&chan->ctrl_handler, MAX_CID_CONTROLS);
 	if (chan->ctrl_handler.error) {
 		dev_err(&chan->video->dev, "failed to init control handler\n");
@@ -2474,7 +4431,9 @@ int tegra_channel_init_video(struct tegra_channel *chan)
 	chan->video->vfl_type = VFL_TYPE_GRABBER;
 #else
 	chan->video->vfl_type = VFL_TYPE_VIDEO;
-	chan->video->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	chan->video->device_caps = chan->multiplanar ?
+		V4L2_CAP_VIDEO_CAPTURE_MPLANE : V4L2_CAP_VIDEO_CAPTURE;
+	chan->video->device_caps |= V4L2_CAP_STREAMING;
 	chan->video->device_caps |= V4L2_CAP_EXT_PIX_FORMAT;
 #endif
 	chan->video->vfl_dir = VFL_DIR_RX;
@@ -2514,6 +4473,8 @@ int tegra_channel_init(struct tegra_channel *chan)
 	chan->stride_align = TEGRA_STRIDE_ALIGNMENT;
 	chan->height_align = TEGRA_HEIGHT_ALIGNMENT;
 	chan->size_align = size_align_ctrl_qmenu[TEGRA_SIZE_ALIGNMENT];
+	chan->gang_split = TEGRA_GANG_SPLIT_AUTO;
+	chan->multiplanar = tegra_channel_port_multiplanar(chan);
 	chan->num_subdevs = 0;
 	mutex_init(&chan->video_lock);
 	chan->capture_descr_index = 0;
@@ -2538,6 +4499,16 @@ int tegra_channel_init(struct tegra_channel *chan)
 
 	/* Init video format */
 	vi->fops->vi_init_video_formats(chan);
+	ret = tegra_channel_fmt_index_build(chan);
+	if (ret)
+		return ret;
+	ret = tegra_channel_try_cache_init(chan);
+	if (ret)
+		return ret;
+	chan->ctrl_cache = devm_kzalloc(vi->dev, sizeof(*chan->ctrl_cache),
+			GFP_KERNEL);
+	if (!chan->ctrl_cache)
+		return -ENOMEM;
 	chan->fmtinfo = tegra_core_get_default_format();
 	tegra_channel_update_format(chan, TEGRA_DEF_WIDTH,
 				TEGRA_DEF_HEIGHT,
@@ -2551,14 +4522,17 @@ int tegra_channel_init(struct tegra_channel *chan)
 
 #if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
 	/* get the buffers queue... */
+	mutex_lock(&tegra_vi_dma_lock);
 	ret = tegra_vb2_dma_init(vi_unit_dev, &chan->alloc_ctx,
 			SZ_64K, &vi->vb2_dma_alloc_refcnt);
+	mutex_unlock(&tegra_vi_dma_lock);
 	if (ret < 0)
 		goto vb2_init_error;
 
 #endif
 
-	chan->queue.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	chan->queue.type = chan->multiplanar ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	chan->queue.io_modes = VB2_MMAP | VB2_DMABUF | VB2_READ | VB2_USERPTR;
 	chan->queue.lock = &chan->video_lock;
 	chan->queue.drv_priv = chan;
@@ -2569,12 +4543,23 @@ int tegra_channel_init(struct tegra_channel *chan)
 #endif
 	chan->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
 				   | V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	/* per-frame control bundles through the media request API */
+	chan->queue.supports_requests = true;
+#endif
 	ret = vb2_queue_init(&chan->queue);
 	if (ret < 0) {
 		dev_err(chan->vi->dev, "failed to initialize VB2 queue\n");
 		goto vb2_queue_error;
 	}
 
+	ret = tegra_channel_emb_queue_init(chan);
+	if (ret < 0) {
+		dev_err(chan->vi->dev,
+			"failed to initialize embedded data queue\n");
+		goto emb_queue_error;
+	}
+
 	chan->deskew_ctx = devm_kzalloc(vi->dev,
 			sizeof(struct nvcsi_deskew_context), GFP_KERNEL);
 	if (!chan->deskew_ctx) {
@@ -2588,10 +4573,15 @@ int tegra_channel_init(struct tegra_channel *chan)
 
 deskew_ctx_err:
 	devm_kfree(vi->dev, chan->deskew_ctx);
+	vb2_queue_release(&chan->emb_queue);
+emb_queue_error:
+	vb2_queue_release(&chan->queue);
 vb2_queue_error:
 #if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
+	mutex_lock(&tegra_vi_dma_lock);
 	tegra_vb2_dma_cleanup(vi_unit_dev, chan->alloc_ctx,
 		&vi->vb2_dma_alloc_refcnt);
+	mutex_unlock(&tegra_vi_dma_lock);
 vb2_init_error:
 #endif
 	v4l2_ctrl_handler_free(&chan->ctrl_handler);
@@ -2612,6 +4602,7 @@ int tegra_channel_cleanup(struct tegra_channel *chan)
 	struct device *vi_unit_dev = tegra_channel_get_vi_unit(chan);
 
 	/* release embedded data buffer */
+	tegra_channel_emb_restore(chan);
 	if (chan->emb_buf_size > 0) {
 		dma_free_coherent(vi_unit_dev,
 			chan->emb_buf_size,
@@ -2622,11 +4613,22 @@ int tegra_channel_cleanup(struct tegra_channel *chan)
 	tegra_channel_dealloc_buffer_queue(chan);
 
 	v4l2_ctrl_handler_free(&chan->ctrl_handler);
+	/* controls alias the blob, free it only after the handler */
+	kfree(chan->props_blob);
+	chan->props_blob = NULL;
+	chan->props_blob_src = NULL;
+
+	mutex_lock(&chan->emb_video_lock);
+	vb2_queue_release(&chan->emb_queue);
+	mutex_unlock(&chan->emb_video_lock);
+
 	mutex_lock(&chan->video_lock);
 	vb2_queue_release(&chan->queue);
 #if defined(CONFIG_VIDEOBUF2_DMA_CONTIG)
+	mutex_lock(&tegra_vi_dma_lock);
 	tegra_vb2_dma_cleanup(vi_unit_dev, chan->alloc_ctx,
 		&chan->vi->vb2_dma_alloc_refcnt);
+	mutex_unlock(&tegra_vi_dma_lock);
 #endif
 	mutex_unlock(&chan->video_lock);
 
@@ -2654,21 +4656,93 @@ int tegra_vi_mfi_work(struct tegra_mc_vi *vi, int channel)
 }
 EXPORT_SYMBOL(tegra_vi_mfi_work);
 
+static void tegra_channel_init_async(void *data, async_cookie_t cookie)
+{
+	struct tegra_channel_async_work *work = data;
+	ktime_t start = ktime_get();
+
+	work->ret = tegra_channel_init(work->chan);
+	work->time_us = ktime_us_delta(ktime_get(), start);
+}
+
+static void tegra_channel_cleanup_async(void *data, async_cookie_t cookie)
+{
+	struct tegra_channel_async_work *work = data;
+
+	work->ret = tegra_channel_cleanup(work->chan);
+}
+
+/*
+ * Run @fn for every channel (all of them when @all, else the initialized
+ * ones) concurrently and wait for all of them. Returns the number of
+ * channels or -ENOMEM; results are left in *works for the caller to free.
+ */
+static int tegra_vi_channels_run_async(struct tegra_mc_vi *vi,
+	async_func_t fn, bool all, struct tegra_channel_async_work **works)
+{
+	struct tegra_channel_async_work *work;
+	struct tegra_channel *it;
+	int num = 0, i = 0;
+
+	list_for_each_entry(it, &vi->vi_chans, list)
+		if (all || it->init_done)
+			num++;
+
+	work = kcalloc(num, sizeof(*work), GFP_KERNEL);
+	if (num && !work)
+		return -ENOMEM;
+
+	list_for_each_entry(it, &vi->vi_chans, list) {
+		if (!all && !it->init_done)
+			continue;
+		work[i].chan = it;
+		async_schedule_domain(fn, &work[i], &tegra_vi_chan_domain);
+		i++;
+	}
+	async_synchronize_full_domain(&tegra_vi_chan_domain);
+
+	*works = work;
+	return num;
+}
+
 int tegra_vi_channels_init(struct tegra_mc_vi *vi)
 {
-	int ret = 0;
+	struct tegra_channel_async_work *work;
 	struct tegra_channel *it;
+	ktime_t start = ktime_get();
+	int ret = 0;
 	int count = 0;
+	int num, i;
 
-	list_for_each_entry(it, &vi->vi_chans, list) {
+	list_for_each_entry(it, &vi->vi_chans, list)
 		it->vi = vi;
-		ret = tegra_channel_init(it);
-		if (ret < 0) {
-			dev_err(vi->dev, "channel init failed\n");
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	/* shared by every channel queue, set before they come up */
+	if (!vi->media_dev.ops)
+		vi->media_dev.ops = &tegra_channel_media_ops;
+#endif
+
+	num = tegra_vi_channels_run_async(vi, tegra_channel_init_async,
+			true, &work);
+	if (num < 0)
+		return num;
+
+	for (i = 0; i < num; i++) {
+		if (work[i].ret < 0) {
+			ret = work[i].ret;
+			dev_err(vi->dev, "channel %u init failed\n",
+				work[i].chan->id);
 			continue;
 		}
+		dev_info(vi->dev, "channel %u init took %lld us\n",
+			work[i].chan->id, work[i].time_us);
 		count++;
 	}
+	kfree(work);
+
+	dev_info(vi->dev, "%d of %d channels ready in %lld us\n",
+		count, num, ktime_us_delta(ktime_get(), start));
 
 	if (count == 0) {
 		dev_err(vi->dev, "all channel init failed\n");
@@ -2680,19 +4754,24 @@ int tegra_vi_channels_init(struct tegra_mc_vi *vi)
 EXPORT_SYMBOL(tegra_vi_channels_init);
 int tegra_vi_channels_cleanup(struct tegra_mc_vi *vi)
 {
-	int ret = 0, err = 0;
-	struct tegra_channel *it;
+	struct tegra_channel_async_work *work;
+	int ret = 0;
+	int num, i;
 
-	list_for_each_entry(it, &vi->vi_chans, list) {
-		if (!it->init_done)
-			continue;
-		err = tegra_channel_cleanup(it);
-		if (err < 0) {
-			ret = err;
+	num = tegra_vi_channels_run_async(vi, tegra_channel_cleanup_async,
+			false, &work);
+	if (num < 0)
+		return num;
+
+	for (i = 0; i < num; i++) {
+		if (work[i].ret < 0) {
+			ret = work[i].ret;
 			dev_err(vi->dev, "channel cleanup failed, err %d\n",
-					err);
+					work[i].ret);
 		}
 	}
+	kfree(work);
+
 	return ret;
 }
 EXPORT_SYMBOL(tegra_vi_channels_cleanup);
@@ -1,8 +1,12 @@
+#include <linux/debugfs.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/platform_device.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
 #include <linux/videodev2.h>
+#include <media/v4l2-async.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-ioctl.h>
 #include <media/videobuf2-v4l2.h>
@@ -10,6 +14,11 @@
 #include <media/v4l2-fwnode.h>
 #include <media/videobuf2-dma-contig.h>
 
+#include "debug_v4l2.h"
+#include "evring.h"
+#include "hotlog.h"
+#include "interpose.h"
+
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Your Name");
 MODULE_DESCRIPTION("A simple fake V4L2 video driver");
@@ -41,6 +50,117 @@ struct sun6i_csi_dev {
 
 
 static struct sun6i_csi_dev *_sdev;
+static struct dentry *debugfs_root;
+
+struct dentry *my_debug_v4l2_debugfs_root(void)
+{
+	return debugfs_root;
+}
+
+/*
+ * Boot timeline ring. Oldest spans are overwritten once it is full; the
+ * times are since boot so the output lines up with the camera
+ * availability deadline.
+ */
+#define TIMELINE_SLOTS	256
+
+struct timeline_span {
+	s64 start_ns;
+	s64 end_ns;
+	enum my_debug_v4l2_phase phase;
+	char label[32];
+};
+
+static struct timeline_span timeline[TIMELINE_SLOTS];
+static unsigned int timeline_head;
+static unsigned int timeline_count;
+static DEFINE_SPINLOCK(timeline_lock);
+
+static const char * const timeline_phase_names[MY_DEBUG_V4L2_NUM_PHASES] = {
+	[MY_DEBUG_V4L2_PDEV_REGISTER] = "pdev_register",
+	[MY_DEBUG_V4L2_NOTIFIER_REGISTER] = "notifier_register",
+	[MY_DEBUG_V4L2_SUBDEV_BOUND] = "subdev_bound",
+	[MY_DEBUG_V4L2_NOTIFY_COMPLETE] = "notify_complete",
+	[MY_DEBUG_V4L2_VIDEO_REGISTER] = "video_register",
+	[MY_DEBUG_V4L2_CTRL_SETUP] = "ctrl_setup",
+};
+
+void my_debug_v4l2_timeline_add(enum my_debug_v4l2_phase phase,
+		const char *label, ktime_t start)
+{
+	s64 end_ns = ktime_to_ns(ktime_get_boottime());
+	struct timeline_span *span;
+	unsigned long flags;
+
+	if (phase >= MY_DEBUG_V4L2_NUM_PHASES)
+		return;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	span = &timeline[timeline_head];
+	timeline_head = (timeline_head + 1) % TIMELINE_SLOTS;
+	if (timeline_count < TIMELINE_SLOTS)
+		timeline_count++;
+
+	span->start_ns = ktime_to_ns(start);
+	span->end_ns = end_ns;
+	span->phase = phase;
+	strscpy(span->label, label ? label : "", sizeof(span->label));
+	spin_unlock_irqrestore(&timeline_lock, flags);
+}
+
+static int timeline_show(struct seq_file *s, void *data)
+{
+	s64 total[MY_DEBUG_V4L2_NUM_PHASES] = { 0 };
+	s64 first[MY_DEBUG_V4L2_NUM_PHASES] = { 0 };
+	s64 last[MY_DEBUG_V4L2_NUM_PHASES] = { 0 };
+	s64 ready_ns = 0;
+	unsigned int count[MY_DEBUG_V4L2_NUM_PHASES] = { 0 };
+	unsigned int i, n;
+
+	seq_printf(s, "%12s %12s %10s  %-18s %s\n",
+		"start_us", "end_us", "dur_us", "phase", "label");
+
+	spin_lock_irq(&timeline_lock);
+	n = timeline_count;
+	for (i = 0; i < n; i++) {
+		struct timeline_span *span = &timeline[
+			(timeline_head + TIMELINE_SLOTS - n + i) % TIMELINE_SLOTS];
+		s64 dur = span->end_ns - span->start_ns;
+
+		seq_printf(s, "%12lld %12lld %10lld  %-18s %s\n",
+			div_s64(span->start_ns, NSEC_PER_USEC),
+			div_s64(span->end_ns, NSEC_PER_USEC),
+			div_s64(dur, NSEC_PER_USEC),
+			timeline_phase_names[span->phase], span->label);
+
+		if (!count[span->phase]++)
+			first[span->phase] = span->start_ns;
+		if (span->phase == MY_DEBUG_V4L2_VIDEO_REGISTER && !ready_ns)
+			ready_ns = span->end_ns;
+		last[span->phase] = span->end_ns;
+		total[span->phase] += dur;
+	}
+	spin_unlock_irq(&timeline_lock);
+
+	seq_printf(s, "\n%-18s %6s %12s %12s %12s\n",
+		"phase", "count", "total_us", "first_us", "last_end_us");
+	for (i = 0; i < MY_DEBUG_V4L2_NUM_PHASES; i++) {
+		if (!count[i])
+			continue;
+		seq_printf(s, "%-18s %6u %12lld %12lld %12lld\n",
+			timeline_phase_names[i], count[i],
+			div_s64(total[i], NSEC_PER_USEC),
+			div_s64(first[i], NSEC_PER_USEC),
+			div_s64(last[i], NSEC_PER_USEC));
+	}
+
+	if (ready_ns)
+		seq_printf(s, "\nfirst /dev/video ready %lld us after boot\n",
+			div_s64(ready_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(timeline);
 
 static int fake_driver_probe(struct platform_device *pdev) {
     printk("fake platform driver probe\n");
@@ -123,30 +243,104 @@ static const struct v4l2_async_notifier_operations sun6i_csi_async_ops = {
 	.complete = sun6i_subdev_notify_complete,
 };
 
-static int (*prev_complete)(struct v4l2_async_notifier *notifier);
-
-
 extern int my_tegra_vi_graph_notify_complete2(struct v4l2_async_notifier *notifier);
 extern int my_tegra_vi_graph_notify_complete(struct v4l2_async_notifier *notifier);
+extern int my_tegra_vi_graph_subdev_bound(struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev);
+extern bool my_tegra_vi_graph_subdev_unbind(struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev);
+extern bool my_tegra_vi_graph_linked(struct v4l2_async_notifier *notifier);
+extern void my_tegra_vi_graph_wrap_subdev(struct v4l2_subdev *sd);
+extern void my_tegra_vi_graph_unwrap_subdev(struct v4l2_subdev *sd);
+
+INTERPOSE_CB_WRAP(notifier_ops, struct v4l2_async_notifier_operations, bound,
+	my_bound, int, (struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev, struct v4l2_async_subdev *asd),
+	(notifier, subdev, asd), notifier->ops);
+INTERPOSE_CB_WRAP(notifier_ops, struct v4l2_async_notifier_operations,
+	complete, my_complete, int, (struct v4l2_async_notifier *notifier),
+	(notifier), notifier->ops);
+INTERPOSE_CB_VOID_WRAP(notifier_ops, struct v4l2_async_notifier_operations,
+	unbind, my_unbind, (struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev, struct v4l2_async_subdev *asd),
+	(notifier, subdev, asd), notifier->ops);
+INTERPOSE_TABLE(notifier_ops, struct v4l2_async_notifier_operations,
+	INTERPOSE_SLOT(notifier_ops, bound),
+	INTERPOSE_SLOT(notifier_ops, complete),
+	INTERPOSE_SLOT(notifier_ops, unbind));
+
+static int my_bound(struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev, struct v4l2_async_subdev *asd)
+{
+	ktime_t start = ktime_get_boottime();
+	int ret = 0;
+
+	if (INTERPOSE_ORIG(notifier_ops, bound, notifier->ops))
+		ret = INTERPOSE_ORIG(notifier_ops, bound, notifier->ops)(
+				notifier, subdev, asd);
+	if (ret < 0)
+		return ret;
+
+	my_tegra_vi_graph_wrap_subdev(subdev);
+#ifdef NVIDIA
+	/* relink only this entity if the graph is already up */
+	ret = my_tegra_vi_graph_subdev_bound(notifier, subdev);
+#endif
+	evring_emit(EVRING_CHAN_NONE, EVRING_EV_SUBDEV_BOUND,
+			ktime_to_ns(ktime_sub(ktime_get_boottime(), start)), ret);
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_SUBDEV_BOUND, subdev->name,
+			start);
+	return ret;
+}
+
+static void my_unbind(struct v4l2_async_notifier *notifier,
+		struct v4l2_subdev *subdev, struct v4l2_async_subdev *asd)
+{
+	bool detached = false;
+
+	my_tegra_vi_graph_unwrap_subdev(subdev);
+#ifdef NVIDIA
+	/* the original unbind would tear the whole channel down */
+	detached = my_tegra_vi_graph_subdev_unbind(notifier, subdev);
+#endif
+	evring_emit(EVRING_CHAN_NONE, EVRING_EV_SUBDEV_UNBIND, 0, detached);
+	if (!detached && INTERPOSE_ORIG(notifier_ops, unbind, notifier->ops))
+		INTERPOSE_ORIG(notifier_ops, unbind, notifier->ops)(notifier,
+				subdev, asd);
+}
 
 static int my_complete(struct v4l2_async_notifier *notifier)
 {
+	ktime_t start = ktime_get_boottime();
+	int ret = 0;
+
 #ifdef NVIDIA
-	printk("my_complete jiangjqian\n");
+	hotlog_info("my_complete %p\n", notifier);
 #else
 	struct sun6i_csi *csi;
 	csi = container_of(notifier->v4l2_dev, struct sun6i_csi, v4l2_dev);
-	printk("my_complete csi v4l2_dev name %s\n", csi->v4l2_dev.name);
+	pr_debug("my_complete csi v4l2_dev name %s\n", csi->v4l2_dev.name);
 #endif
 
+#ifdef NVIDIA
+	/*
+	 * complete runs again when a sub-device rebinds; the graph is
+	 * still registered and my_bound has already relinked it.
+	 */
+	if (my_tegra_vi_graph_linked(notifier))
+		return 0;
+#endif
 	my_tegra_vi_graph_notify_complete2(notifier);
-	return prev_complete(notifier);
+	if (INTERPOSE_ORIG(notifier_ops, complete, notifier->ops))
+		ret = INTERPOSE_ORIG(notifier_ops, complete,
+				notifier->ops)(notifier);
+	evring_emit(EVRING_CHAN_NONE, EVRING_EV_NOTIFY_COMPLETE,
+			ktime_to_ns(ktime_sub(ktime_get_boottime(), start)), ret);
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_NOTIFY_COMPLETE,
+			notifier->v4l2_dev->name, start);
+	return ret;
 }
 
-static struct v4l2_async_notifier_operations my_ops = {
-	.complete = my_complete,
-};
-
 
 static void countNodes(struct list_head *head) {
     struct list_head *pos;
@@ -155,7 +349,7 @@ static void countNodes(struct list_head *head) {
     list_for_each(pos, head) {
 	notifier = container_of(pos, struct v4l2_async_notifier, list);
 	if(notifier->v4l2_dev == NULL || notifier->v4l2_dev->name == NULL){
-		printk("%s:%d v4l2_dev is NULL or name is NULL\n", __FILE__, __LINE__);
+		hotlog_warn("v4l2_dev is NULL or name is NULL\n");
 		continue;
 	}
 #ifdef NVIDIA
@@ -163,21 +357,18 @@ static void countNodes(struct list_head *head) {
 #else
 	if(strstr(notifier->v4l2_dev->name, "fake") != NULL){
 #endif
-		printk("find the notifier\n");
+		hotlog_info("find the notifier %p\n", notifier);
 	} else continue;
 
 #ifdef NVIDIA
 	//to be sure if bound and unbind is NULL
-	printk("complete pointer %p\n", notifier->ops->complete);
-	printk("bound pointer %p\n", notifier->ops->bound);
-	printk("unbind pointer %p\n", notifier->ops->unbind);
+	hotlog_dbg("complete %p bound %p unbind %p\n",
+		notifier->ops->complete, notifier->ops->bound,
+		notifier->ops->unbind);
 #endif
 
-	prev_complete = notifier->ops->complete;
-
-	my_ops.bound = notifier->ops->bound;
-	my_ops.unbind = notifier->ops->unbind;
-	notifier->ops = &my_ops;
+	if (INTERPOSE_ATTACH(notifier_ops, &notifier->ops))
+		continue;
 
 #ifndef NVIDIA
 	notifier->ops->complete(notifier);
@@ -187,9 +378,23 @@ static void countNodes(struct list_head *head) {
 }
 static int sun6i_csi_v4l2_init(struct sun6i_csi *csi)
 {
+	struct v4l2_async_subdev *asd;
+	ktime_t start;
 	int ret;
 
+	csi->media_dev.dev = csi->dev;
+	strscpy(csi->media_dev.model, "fake csi", sizeof(csi->media_dev.model));
+	media_device_init(&csi->media_dev);
+
 	v4l2_async_notifier_init(&csi->notifier);
+	if (sw_sensor_devname()) {
+		asd = v4l2_async_notifier_add_devname_subdev(&csi->notifier,
+				sw_sensor_devname(), sizeof(*asd));
+		if (IS_ERR(asd)) {
+			ret = PTR_ERR(asd);
+			goto clean_media;
+		}
+	}
 
 	ret = v4l2_ctrl_handler_init(&csi->ctrl_handler, 0);
 	if (ret) {
@@ -208,7 +413,10 @@ static int sun6i_csi_v4l2_init(struct sun6i_csi *csi)
 	}
 
 	csi->notifier.ops = &sun6i_csi_async_ops;
+	start = ktime_get_boottime();
 	ret = v4l2_async_notifier_register(&csi->v4l2_dev, &csi->notifier);
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_NOTIFIER_REGISTER,
+			csi->v4l2_dev.name, start);
 	if (ret) {
 		dev_err(csi->dev, "notifier registration failed\n");
 		goto unreg_v4l2;
@@ -225,6 +433,7 @@ free_ctrl:
 	v4l2_ctrl_handler_free(&csi->ctrl_handler);
 clean_media:
 	v4l2_async_notifier_cleanup(&csi->notifier);
+	media_device_cleanup(&csi->media_dev);
 
 	return ret;
 }
@@ -235,19 +444,46 @@ clean_media:
 static int __init mymodule_init(void)
 {
 	//struct sun6i_csi_dev *sdev; //_sdev
+	ktime_t start;
 	int ret;
 
 	struct platform_device *pdev;
 
 
+	debugfs_root = debugfs_create_dir("my_debug_v4l2", NULL);
+	if (IS_ERR(debugfs_root))
+		debugfs_root = NULL;
+	if (debugfs_root) {
+		debugfs_create_file("timeline", 0444, debugfs_root, NULL,
+				&timeline_fops);
+		my_tegra_vi_graph_debugfs_init(debugfs_root);
+		sw_topo_debugfs_init(debugfs_root);
+		interpose_debugfs_init(debugfs_root);
+	}
+	if (hotlog_init(debugfs_root))
+		pr_warn("hotlog rings unavailable, hot path logging off\n");
+	if (evring_init(debugfs_root))
+		pr_warn("event ring unavailable, events off\n");
+
+	start = ktime_get_boottime();
     	pdev = create_fake_platform_device();
-	if(pdev == NULL) return -ENOMEM;
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_PDEV_REGISTER,
+			"fake_platform_device", start);
+	if(pdev == NULL) {
+		evring_exit();
+		debugfs_remove_recursive(debugfs_root);
+		hotlog_exit();
+		return -ENOMEM;
+	}
 
 
 	_sdev = devm_kzalloc(&pdev->dev, sizeof(*_sdev), GFP_KERNEL);
 	if (!_sdev){
         	platform_device_put(pdev);
         	platform_driver_unregister(&fake_platform_driver);
+		evring_exit();
+		debugfs_remove_recursive(debugfs_root);
+		hotlog_exit();
 		return -ENOMEM;
 	}
 
@@ -256,11 +492,18 @@ static int __init mymodule_init(void)
 	platform_set_drvdata(pdev, _sdev);
 
 	_sdev->csi.dev = &pdev->dev;
+	/* registered first, the notifier matches it by device name */
+	if (sw_sensor_init())
+		pr_warn("synthetic sensor unavailable\n");
 	ret = sun6i_csi_v4l2_init(&_sdev->csi);
 	if(ret != 0){
+		sw_sensor_exit();
         	platform_device_put(pdev);
         	platform_driver_unregister(&fake_platform_driver);
 		kfree(_sdev);
+		evring_exit();
+		debugfs_remove_recursive(debugfs_root);
+		hotlog_exit();
 		return ret;
 	}
 	return 0;
@@ -273,12 +516,20 @@ static void __exit mymodule_exit(void)
 {
     struct sun6i_csi *csi = &_sdev->csi;
     pr_info("Exiting fake video driver\n");
+    interpose_restore_all();
+    /* relay removes its own files, before the directory goes */
+    evring_exit();
+    debugfs_remove_recursive(debugfs_root);
+    my_tegra_vi_graph_topo_free_all();
+    hotlog_exit();
     if(_sdev == NULL) return;
 
     v4l2_device_unregister(&csi->v4l2_dev);
     v4l2_ctrl_handler_free(&csi->ctrl_handler);
     v4l2_async_notifier_unregister(&csi->notifier);
     v4l2_async_notifier_cleanup(&csi->notifier);
+    media_device_cleanup(&csi->media_dev);
+    sw_sensor_exit();
     platform_driver_unregister(&fake_platform_driver);
 }
 
@@ -0,0 +1,72 @@
+/*
+ * my_debug_v4l2 shared declarations
+ *
+ * debug_v4l2.c owns the module and its debugfs root; the other objects
+ * of the module register their files under it.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __DEBUG_V4L2_H__
+#define __DEBUG_V4L2_H__
+
+#include <linux/ktime.h>
+
+struct dentry;
+struct device_node;
+struct list_head;
+struct tegra_vi_graph_entity;
+
+/* debugfs "my_debug_v4l2" directory, NULL if debugfs is unavailable */
+struct dentry *my_debug_v4l2_debugfs_root(void);
+
+/*
+ * Boot timeline: spans of the bring-up phases that gate /dev/video
+ * availability, kept in one ring and read from debugfs "timeline".
+ * @start is a ktime_get_boottime() taken when the phase began; the span
+ * ends at the call.
+ */
+enum my_debug_v4l2_phase {
+	MY_DEBUG_V4L2_PDEV_REGISTER,
+	MY_DEBUG_V4L2_NOTIFIER_REGISTER,
+	MY_DEBUG_V4L2_SUBDEV_BOUND,
+	MY_DEBUG_V4L2_NOTIFY_COMPLETE,
+	MY_DEBUG_V4L2_VIDEO_REGISTER,
+	MY_DEBUG_V4L2_CTRL_SETUP,
+	MY_DEBUG_V4L2_NUM_PHASES,
+};
+
+void my_debug_v4l2_timeline_add(enum my_debug_v4l2_phase phase,
+		const char *label, ktime_t start);
+
+/* graph.c: "topology" JSON export and "vi_fops_latency" histograms */
+void my_tegra_vi_graph_debugfs_init(struct dentry *root);
+void my_tegra_vi_graph_topo_free_all(void);
+
+/*
+ * graph.c: graph entities indexed by device_node, built from a list of
+ * struct tegra_vi_graph_entity for the length of one graph build
+ */
+struct tegra_vi_graph_index {
+	unsigned int bits;
+	struct tegra_vi_graph_entity **slots;
+};
+
+int my_tegra_vi_graph_index_build(struct list_head *entities,
+		struct tegra_vi_graph_index *idx);
+void my_tegra_vi_graph_index_free(struct tegra_vi_graph_index *idx);
+struct tegra_vi_graph_entity *
+my_tegra_vi_graph_find_entity(struct tegra_vi_graph_index *idx,
+		const struct device_node *node);
+
+/* sw_sensor.c: synthetic sensor, a no-op unless sw_sensor_enable is set */
+int sw_sensor_init(void);
+void sw_sensor_exit(void);
+/* device name the fake notifier should match, NULL for none */
+const char *sw_sensor_devname(void);
+
+/* sw_topo.c: synthetic large-topology graph build benchmark */
+void sw_topo_debugfs_init(struct dentry *root);
+
+#endif /* __DEBUG_V4L2_H__ */
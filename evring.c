@@ -0,0 +1,198 @@
+/*
+ * evring - relay backend of evring.h
+ *
+ * debugfs files under the module root:
+ *   evring0..N       per-CPU relay buffers, mmap or read
+ *   evring_consumed  write "cpu count" to hand sub-buffers back
+ *   evring_subbuf_size, evring_subbufs
+ *                    geometry of every evringN, mmap needs all of it
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/relay.h>
+#include <linux/sched/clock.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include "evring.h"
+
+static unsigned int evring_subbuf_size = 8192;
+module_param(evring_subbuf_size, uint, 0444);
+MODULE_PARM_DESC(evring_subbuf_size, "evring sub-buffer bytes per CPU");
+
+static unsigned int evring_subbufs = 16;
+module_param(evring_subbufs, uint, 0444);
+MODULE_PARM_DESC(evring_subbufs, "evring sub-buffers per CPU");
+
+static bool evring_overwrite = true;
+module_param(evring_overwrite, bool, 0644);
+MODULE_PARM_DESC(evring_overwrite,
+	"overwrite the oldest events when full instead of dropping new ones");
+
+static struct rchan *evring_chan;
+/* geometry in use, the parameters are only requests */
+static u32 evring_geom_subbuf_size;
+static u32 evring_geom_subbufs;
+static DEFINE_PER_CPU(u32, evring_dropped);
+
+void evring_emit(u16 chan, u32 event, u64 arg0, u64 arg1)
+{
+	u64 ts = local_clock();
+	struct evring_rec *rec;
+	struct rchan *rchan;
+	unsigned long flags;
+
+	/* relay_reserve() is per-CPU and unlocked */
+	local_irq_save(flags);
+	rchan = READ_ONCE(evring_chan);
+	if (likely(rchan)) {
+		rec = relay_reserve(rchan, sizeof(*rec));
+		if (likely(rec)) {
+			rec->cpu = smp_processor_id();
+			rec->chan = chan;
+			rec->event = event;
+			rec->arg0 = arg0;
+			rec->arg1 = arg1;
+			/* the reader takes a non-zero ts_ns as committed */
+			smp_store_release(&rec->ts_ns, ts ? ts : 1);
+		} else {
+			__this_cpu_inc(evring_dropped);
+		}
+	}
+	local_irq_restore(flags);
+}
+
+static int evring_subbuf_start(struct rchan_buf *buf, void *subbuf,
+		void *prev_subbuf, size_t prev_padding)
+{
+	struct evring_subbuf_hdr *hdr;
+
+	if (!READ_ONCE(evring_overwrite) && relay_buf_full(buf))
+		return 0;
+
+	if (prev_subbuf) {
+		hdr = prev_subbuf;
+		hdr->padding = prev_padding;
+		smp_store_release(&hdr->done, 1);
+	}
+
+	hdr = subbuf;
+	WRITE_ONCE(hdr->seq, EVRING_SEQ_BUSY);
+	smp_wmb();
+	memset(hdr + 1, 0, buf->chan->subbuf_size - sizeof(*hdr));
+	hdr->magic = EVRING_MAGIC;
+	hdr->cpu = buf->cpu;
+	hdr->subbuf_size = buf->chan->subbuf_size;
+	hdr->n_subbufs = buf->chan->n_subbufs;
+	hdr->done = 0;
+	hdr->padding = 0;
+	hdr->dropped = per_cpu(evring_dropped, buf->cpu);
+	smp_store_release(&hdr->seq, buf->subbufs_produced);
+
+	subbuf_start_reserve(buf, sizeof(*hdr));
+	return 1;
+}
+
+static struct dentry *evring_create_buf_file(const char *filename,
+		struct dentry *parent, umode_t mode, struct rchan_buf *buf,
+		int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+			&relay_file_operations);
+}
+
+static int evring_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static struct rchan_callbacks evring_callbacks = {
+	.subbuf_start = evring_subbuf_start,
+	.create_buf_file = evring_create_buf_file,
+	.remove_buf_file = evring_remove_buf_file,
+};
+
+static ssize_t evring_consumed_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	unsigned int cpu, n;
+	char buf[32];
+	struct rchan *rchan = READ_ONCE(evring_chan);
+
+	if (!rchan)
+		return -ENODEV;
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &cpu, &n) != 2 || cpu >= nr_cpu_ids ||
+			!cpu_possible(cpu))
+		return -EINVAL;
+	relay_subbufs_consumed(rchan, cpu, n);
+
+	return count;
+}
+
+static const struct file_operations evring_consumed_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = evring_consumed_write,
+	.llseek = noop_llseek,
+};
+
+int evring_init(struct dentry *root)
+{
+	size_t subbuf_size;
+	struct rchan *rchan;
+
+	BUILD_BUG_ON(sizeof(struct evring_rec) != 32);
+	BUILD_BUG_ON(sizeof(struct evring_subbuf_hdr) !=
+			sizeof(struct evring_rec));
+
+	if (!root)
+		return -ENODEV;
+
+	/* whole records only, so sub-buffers never carry padding */
+	subbuf_size = rounddown(evring_subbuf_size, sizeof(struct evring_rec));
+	if (subbuf_size < 2 * sizeof(struct evring_rec) ||
+			evring_subbufs < 2 || evring_subbufs > U16_MAX)
+		return -EINVAL;
+
+	rchan = relay_open("evring", root, subbuf_size, evring_subbufs,
+			&evring_callbacks, NULL);
+	if (!rchan)
+		return -ENOMEM;
+
+	evring_geom_subbuf_size = subbuf_size;
+	evring_geom_subbufs = evring_subbufs;
+	debugfs_create_u32("evring_subbuf_size", 0444, root,
+			&evring_geom_subbuf_size);
+	debugfs_create_u32("evring_subbufs", 0444, root, &evring_geom_subbufs);
+	debugfs_create_file("evring_consumed", 0200, root, NULL,
+			&evring_consumed_fops);
+	WRITE_ONCE(evring_chan, rchan);
+
+	return 0;
+}
+
+void evring_exit(void)
+{
+	struct rchan *rchan = evring_chan;
+
+	if (!rchan)
+		return;
+
+	WRITE_ONCE(evring_chan, NULL);
+	/* writers run with interrupts off, this waits them out */
+	synchronize_rcu();
+	relay_close(rchan);
+}
@@ -0,0 +1,85 @@
+/*
+ * evring - per-CPU binary event ring of my_debug_v4l2
+ *
+ * Events are fixed 32-byte records written into a relay channel, one
+ * buffer per CPU, exported as debugfs evring0..evringN under the module
+ * root. Userspace mmaps those files and consumes them with
+ * evring_reader.c; this header is shared with it.
+ *
+ * Every relay sub-buffer starts with a struct evring_subbuf_hdr in the
+ * first record slot. A sub-buffer is cleared when the writer enters it,
+ * so a record is valid once its ts_ns is non-zero; ts_ns is stored last.
+ * hdr->seq is EVRING_SEQ_BUSY while the sub-buffer is being cleared and
+ * the number of sub-buffers produced before it otherwise, letting a
+ * reader detect that the writer lapped it in overwrite mode.
+ *
+ * With evring_overwrite=0 the writer stops when every sub-buffer is
+ * unread, counts the records it drops, and resumes once the reader
+ * writes "cpu count" to debugfs evring_consumed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __EVRING_H__
+#define __EVRING_H__
+
+#include <linux/types.h>
+
+#define EVRING_MAGIC		0x47525645	/* "EVRG" */
+#define EVRING_SEQ_BUSY		(~0ULL)
+/* channel id of events not tied to a channel */
+#define EVRING_CHAN_NONE	0xffff
+
+struct evring_rec {
+	__u64 ts_ns;
+	__u16 cpu;
+	__u16 chan;
+	__u32 event;
+	__u64 arg0;
+	__u64 arg1;
+};
+
+struct evring_subbuf_hdr {
+	__u32 magic;
+	__u32 cpu;
+	__u64 seq;
+	__u32 subbuf_size;
+	__u16 n_subbufs;
+	/* set once the writer has moved to the next sub-buffer */
+	__u16 done;
+	/* unused bytes at the end of a done sub-buffer */
+	__u32 padding;
+	/* records dropped on this CPU before the sub-buffer started */
+	__u32 dropped;
+};
+
+/* arg0 and arg1 of each event */
+enum evring_event {
+	EVRING_EV_NONE = 0,
+	/* duration ns, return value */
+	EVRING_EV_SUBDEV_BOUND,
+	/* 0, 0 */
+	EVRING_EV_SUBDEV_UNBIND,
+	/* duration ns, return value */
+	EVRING_EV_NOTIFY_COMPLETE,
+	/* tegra_vi_fops callbacks: duration ns, return value */
+	EVRING_EV_VI_POWER_ON,
+	EVRING_EV_VI_START_STREAMING,
+	EVRING_EV_VI_STOP_STREAMING,
+	EVRING_EV_VI_SETUP_QUEUE,
+	EVRING_EV_VI_ERROR_RECOVER,
+	EVRING_EV_VI_ADD_CTRLS,
+	EVRING_EV_VI_INIT_VIDEO_FORMATS,
+	EVRING_EV_NUM,
+};
+
+#ifdef __KERNEL__
+struct dentry;
+
+void evring_emit(u16 chan, u32 event, u64 arg0, u64 arg1);
+int evring_init(struct dentry *root);
+void evring_exit(void);
+#endif
+
+#endif /* __EVRING_H__ */
@@ -0,0 +1,102 @@
+/*
+ * evring_dump - print the my_debug_v4l2 event ring as text
+ *
+ * Built on evring_reader.c. Prints what is in the rings and exits, or
+ * keeps following them with -f.
+ *
+ *   cc -o evring_dump evring_dump.c evring_reader.c
+ *   ./evring_dump [-f] [-i interval_ms] [-d debugfs dir]
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "evring_reader.h"
+
+static const char * const event_names[EVRING_EV_NUM] = {
+	[EVRING_EV_NONE] = "none",
+	[EVRING_EV_SUBDEV_BOUND] = "subdev_bound",
+	[EVRING_EV_SUBDEV_UNBIND] = "subdev_unbind",
+	[EVRING_EV_NOTIFY_COMPLETE] = "notify_complete",
+	[EVRING_EV_VI_POWER_ON] = "vi_power_on",
+	[EVRING_EV_VI_START_STREAMING] = "vi_start_streaming",
+	[EVRING_EV_VI_STOP_STREAMING] = "vi_stop_streaming",
+	[EVRING_EV_VI_SETUP_QUEUE] = "vi_setup_queue",
+	[EVRING_EV_VI_ERROR_RECOVER] = "vi_error_recover",
+	[EVRING_EV_VI_ADD_CTRLS] = "vi_add_ctrls",
+	[EVRING_EV_VI_INIT_VIDEO_FORMATS] = "vi_init_video_formats",
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static void print_rec(const struct evring_rec *rec, void *arg)
+{
+	printf("[%6llu.%06llu] cpu%u ",
+		(unsigned long long)(rec->ts_ns / 1000000000),
+		(unsigned long long)(rec->ts_ns % 1000000000 / 1000),
+		rec->cpu);
+	if (rec->chan == EVRING_CHAN_NONE)
+		printf("   - ");
+	else
+		printf("%4u ", rec->chan);
+	if (rec->event < EVRING_EV_NUM && event_names[rec->event])
+		printf("%-22s", event_names[rec->event]);
+	else
+		printf("event%-17u", rec->event);
+	/* every event defined so far carries a duration and a return value */
+	printf(" %10llu ns  ret %lld\n", (unsigned long long)rec->arg0,
+		(long long)rec->arg1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = NULL;
+	struct evring_reader *r;
+	int follow = 0, interval_ms = 100;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "fi:d:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			follow = 1;
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-f] [-i interval_ms] [-d dir]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	r = evring_reader_open(dir);
+	if (!r) {
+		perror("evring_reader_open");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	do {
+		evring_reader_poll(r, print_rec, NULL);
+		fflush(stdout);
+		if (follow)
+			usleep(interval_ms * 1000);
+	} while (follow && !stop);
+
+	fprintf(stderr, "lost %llu (overwritten), dropped %llu (ring full)\n",
+		evring_reader_lost(r), evring_reader_dropped(r));
+	evring_reader_close(r);
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * evring_reader - see evring_reader.h
+ *
+ * Per CPU the reader remembers the sequence number of the sub-buffer it
+ * is in and how many of its records it has delivered. Records are copied
+ * out and delivered only if the sub-buffer's seq did not change across
+ * the copy, so a writer lapping the reader costs records, never garbage.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "evring_reader.h"
+
+#define MAX_CPUS	1024
+
+struct evring_cpu {
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	unsigned int subbuf_size;
+	unsigned int n_subbufs;
+	unsigned long long next_seq;
+	unsigned int next_rec;
+	/* sub-buffers finished since the last evring_consumed write */
+	unsigned int consumed;
+	unsigned int dropped;
+	struct evring_rec *copy;
+};
+
+struct evring_reader {
+	int consumed_fd;
+	unsigned int num_cpus;
+	unsigned long long lost;
+	struct evring_cpu cpus[MAX_CPUS];
+};
+
+static int evring_read_u32(const char *dir, const char *name,
+		unsigned int *val)
+{
+	char path[512];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fscanf(f, "%u", val) == 1 ? 0 : -1;
+	fclose(f);
+	if (ret)
+		errno = EPROTO;
+
+	return ret;
+}
+
+static int evring_cpu_map(struct evring_cpu *c, const char *path,
+		unsigned int subbuf_size, unsigned int n_subbufs)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	c->fd = open(path, O_RDONLY);
+	if (c->fd == -1)
+		return -1;
+
+	/* relay only maps the whole buffer */
+	c->subbuf_size = subbuf_size;
+	c->n_subbufs = n_subbufs;
+	c->map_size = (size_t)subbuf_size * n_subbufs;
+	c->map_size = (c->map_size + page - 1) / page * page;
+	c->map = mmap(NULL, c->map_size, PROT_READ, MAP_SHARED, c->fd, 0);
+	if (c->map == MAP_FAILED)
+		goto err;
+
+	c->copy = malloc(subbuf_size);
+	if (!c->copy) {
+		munmap(c->map, c->map_size);
+		goto err;
+	}
+
+	return 0;
+err:
+	c->map = NULL;
+	close(c->fd);
+	return -1;
+}
+
+struct evring_reader *evring_reader_open(const char *dir)
+{
+	unsigned int cpu, subbuf_size, n_subbufs;
+	struct evring_reader *r;
+	char path[512];
+	int missing = 0;
+
+	if (!dir)
+		dir = EVRING_READER_DIR;
+
+	if (evring_read_u32(dir, "evring_subbuf_size", &subbuf_size) ||
+	    evring_read_u32(dir, "evring_subbufs", &n_subbufs))
+		return NULL;
+	if (subbuf_size < 2 * sizeof(struct evring_rec) || !n_subbufs) {
+		errno = EPROTO;
+		return NULL;
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	/* evringN files exist for possible CPUs, stop after a gap of 64 */
+	for (cpu = 0; cpu < MAX_CPUS && missing < 64; cpu++) {
+		struct evring_cpu *c = &r->cpus[cpu];
+
+		snprintf(path, sizeof(path), "%s/evring%u", dir, cpu);
+		if (evring_cpu_map(c, path, subbuf_size, n_subbufs)) {
+			if (errno != ENOENT) {
+				r->num_cpus = cpu;
+				evring_reader_close(r);
+				return NULL;
+			}
+			missing++;
+			continue;
+		}
+		missing = 0;
+		r->num_cpus = cpu + 1;
+	}
+	if (!r->num_cpus) {
+		free(r);
+		errno = ENOENT;
+		return NULL;
+	}
+
+	snprintf(path, sizeof(path), "%s/evring_consumed", dir);
+	r->consumed_fd = open(path, O_WRONLY);
+
+	return r;
+}
+
+static long evring_cpu_poll(struct evring_reader *r, struct evring_cpu *c,
+		evring_reader_fn fn, void *arg)
+{
+	const unsigned int nrecs = c->subbuf_size / sizeof(struct evring_rec);
+	const struct evring_subbuf_hdr *hdr;
+	const struct evring_rec *recs;
+	unsigned long long seq, seq2;
+	unsigned int end, n, i;
+	long total = 0;
+	__u64 ts;
+
+	for (;;) {
+		hdr = (const void *)(c->map +
+			(c->next_seq % c->n_subbufs) * c->subbuf_size);
+		recs = (const void *)hdr;
+
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq == EVRING_SEQ_BUSY || hdr->magic != EVRING_MAGIC ||
+		    seq < c->next_seq)
+			break;
+		if (seq > c->next_seq) {
+			/* lapped: everything up to this sub-buffer is gone */
+			r->lost += (seq - c->next_seq) * (nrecs - 1) -
+				(c->next_rec ? c->next_rec - 1 : 0);
+			c->next_seq = seq;
+			c->next_rec = 0;
+		}
+		if (!c->next_rec)
+			c->next_rec = 1;
+
+		end = nrecs;
+		if (__atomic_load_n(&hdr->done, __ATOMIC_ACQUIRE))
+			end -= hdr->padding / sizeof(struct evring_rec);
+		for (n = 0, i = c->next_rec; i < end; i++, n++) {
+			ts = __atomic_load_n(&recs[i].ts_ns, __ATOMIC_ACQUIRE);
+			if (!ts)
+				break;
+			c->copy[n] = recs[i];
+		}
+		c->dropped = hdr->dropped;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED);
+		if (seq2 != seq)
+			continue;
+
+		for (i = 0; i < n; i++)
+			fn(&c->copy[i], arg);
+		total += n;
+		c->next_rec += n;
+
+		if (c->next_rec < end || !hdr->done)
+			break;
+		c->next_seq++;
+		c->next_rec = 0;
+		c->consumed++;
+	}
+
+	return total;
+}
+
+long evring_reader_poll(struct evring_reader *r, evring_reader_fn fn,
+		void *arg)
+{
+	unsigned int cpu;
+	char buf[32];
+	long total = 0;
+	int len;
+
+	for (cpu = 0; cpu < r->num_cpus; cpu++) {
+		struct evring_cpu *c = &r->cpus[cpu];
+
+		if (!c->map)
+			continue;
+		total += evring_cpu_poll(r, c, fn, arg);
+
+		if (c->consumed && r->consumed_fd != -1) {
+			len = snprintf(buf, sizeof(buf), "%u %u", cpu,
+				c->consumed);
+			if (write(r->consumed_fd, buf, len) == len)
+				c->consumed = 0;
+		}
+	}
+
+	return total;
+}
+
+unsigned long long evring_reader_lost(const struct evring_reader *r)
+{
+	return r->lost;
+}
+
+unsigned long long evring_reader_dropped(const struct evring_reader *r)
+{
+	unsigned long long dropped = 0;
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < r->num_cpus; cpu++)
+		dropped += r->cpus[cpu].dropped;
+
+	return dropped;
+}
+
+void evring_reader_close(struct evring_reader *r)
+{
+	unsigned int cpu;
+
+	if (!r)
+		return;
+
+	for (cpu = 0; cpu < r->num_cpus; cpu++) {
+		struct evring_cpu *c = &r->cpus[cpu];
+
+		if (!c->map)
+			continue;
+		munmap(c->map, c->map_size);
+		close(c->fd);
+		free(c->copy);
+	}
+	if (r->consumed_fd > 0)
+		close(r->consumed_fd);
+	free(r);
+}
@@ -0,0 +1,38 @@
+/*
+ * evring_reader - userspace consumer of the my_debug_v4l2 event ring
+ *
+ * Maps every per-CPU evringN file of the debugfs directory and hands
+ * each new record to a callback, CPU by CPU. In stop-when-full mode the
+ * reader gives finished sub-buffers back to the driver after each poll.
+ *
+ *	struct evring_reader *r = evring_reader_open(NULL);
+ *
+ *	while (running)
+ *		evring_reader_poll(r, handle, ctx);
+ *	evring_reader_close(r);
+ */
+#ifndef __EVRING_READER_H__
+#define __EVRING_READER_H__
+
+#include "evring.h"
+
+#define EVRING_READER_DIR	"/sys/kernel/debug/my_debug_v4l2"
+
+struct evring_reader;
+
+typedef void (*evring_reader_fn)(const struct evring_rec *rec, void *arg);
+
+/* NULL @dir means EVRING_READER_DIR; returns NULL with errno set */
+struct evring_reader *evring_reader_open(const char *dir);
+
+/* deliver the records written since the last poll, returns their count */
+long evring_reader_poll(struct evring_reader *r, evring_reader_fn fn,
+		void *arg);
+
+/* records lost to overwrite (approximate) and drops counted by the driver */
+unsigned long long evring_reader_lost(const struct evring_reader *r);
+unsigned long long evring_reader_dropped(const struct evring_reader *r);
+
+void evring_reader_close(struct evring_reader *r);
+
+#endif /* __EVRING_READER_H__ */
@@ -0,0 +1,78 @@
+/*
+ * gang_test - mode matrix check of tegra_channel_gang_bricks()
+ *
+ * Runs the CSI brick count channel.c uses to pick a gang mode over a
+ * matrix of pixel rates, lane counts and bit depths, including the
+ * boundaries where a mode stops fitting a brick.
+ *
+ *   gcc -Wall -o gang_test gang_test.c && ./gang_test
+ *
+ * Exits non-zero if any case fails.
+ */
+#include <stdio.h>
+
+#include "tegra_gang.h"
+
+struct gang_case {
+	__u64 pixel_rate;
+	__u32 num_lanes;
+	__u32 bpp;
+	__u32 bricks;
+};
+
+/* a brick carries 4 lanes x 2.5 Gbps: 1e9 px/s at 10 bpp */
+static const struct gang_case cases[] = {
+	/* nothing known still needs one brick */
+	{ 0, 0, 0, 1 },
+	{ 0, 0, 10, 1 },
+	/* lanes only */
+	{ 0, 1, 0, 1 },
+	{ 0, 4, 0, 1 },
+	{ 0, 5, 0, 2 },
+	{ 0, 8, 0, 2 },
+	{ 0, 12, 0, 3 },
+	/* 1080p30 and 4K30 RAW10 on 4 lanes */
+	{ 74250000, 4, 10, 1 },
+	{ 297000000, 4, 10, 1 },
+	/* the brick capacity boundary at 10 bpp */
+	{ 1000000000, 2, 10, 1 },
+	{ 1000000001, 2, 10, 2 },
+	{ 2000000000, 4, 10, 2 },
+	{ 2000000001, 4, 10, 3 },
+	/* bit depth scales the capacity */
+	{ 1250000000, 4, 8, 1 },
+	{ 1250000001, 4, 8, 2 },
+	{ 1600000000, 4, 12, 2 },
+	{ 625000000, 4, 16, 1 },
+	{ 2600000000ULL, 4, 16, 5 },
+	{ 1000000000, 4, 24, 3 },
+	/* lanes dominate a slow wide mode */
+	{ 100000000, 8, 12, 2 },
+	/* rate dominates a fast narrow mode */
+	{ 4000000000ULL, 2, 10, 4 },
+};
+
+int main(void)
+{
+	unsigned int i, failed = 0;
+	__u32 bricks;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const struct gang_case *c = &cases[i];
+
+		bricks = tegra_channel_gang_bricks(c->pixel_rate,
+				c->num_lanes, c->bpp);
+		if (bricks == c->bricks)
+			continue;
+		printf("FAIL rate %llu lanes %u bpp %u: %u bricks, want %u\n",
+			(unsigned long long)c->pixel_rate, c->num_lanes,
+			c->bpp, bricks, c->bricks);
+		failed++;
+	}
+
+	printf("%u/%u cases passed\n",
+		(unsigned int)(sizeof(cases) / sizeof(cases[0])) - failed,
+		(unsigned int)(sizeof(cases) / sizeof(cases[0])));
+
+	return failed ? 1 : 0;
+}
@@ -10,6 +10,9 @@
  * published by the Free Software Foundation.
  */
 #include <linux/clk.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/of.h>
@@ -18,6 +21,7 @@
 #include <linux/platform_device.h>
 #include <linux/regulator/consumer.h>
 #include <linux/reset.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/version.h>
 #if KERNEL_VERSION(4, 15, 0) > LINUX_VERSION_CODE
@@ -40,6 +44,11 @@
 #include <media/mc_common.h>
 #include <media/csi.h>
 
+#include "debug_v4l2.h"
+#include "evring.h"
+#include "hotlog.h"
+#include "interpose.h"
+
 //#include "nvcsi/nvcsi.h"
 
 
@@ -133,6 +142,7 @@ static int my_tegra_channel_init_video(struct tegra_channel *chan)
 	chan->video->vfl_type = VFL_TYPE_GRABBER;
 #else
 	chan->video->vfl_type = VFL_TYPE_VIDEO;
+	/* the stock channel.c queue is single-planar */
 	chan->video->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
 	chan->video->device_caps |= V4L2_CAP_EXT_PIX_FORMAT;
 #endif
@@ -152,23 +162,397 @@ ctrl_init_error:
 	v4l2_ctrl_handler_free(&chan->ctrl_handler);
 	return ret;
 }
-static struct tegra_vi_graph_entity *
-tegra_vi_graph_find_entity(struct tegra_channel *chan,
-                      const struct device_node *node)
+/*
+ * Entities of a channel indexed by their device_node, open addressed and
+ * at most half full. Built once per graph build so endpoint lookups don't
+ * walk chan->entities for every link.
+ */
+static unsigned int tegra_vi_graph_index_slot(struct tegra_vi_graph_index *idx,
+		const struct device_node *node)
+{
+	unsigned int mask = (1U << idx->bits) - 1;
+	unsigned int slot = hash_ptr(node, idx->bits);
+
+	while (idx->slots[slot] && idx->slots[slot]->node != node)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+int my_tegra_vi_graph_index_build(struct list_head *entities,
+		struct tegra_vi_graph_index *idx)
+{
+	struct tegra_vi_graph_entity *entity;
+	unsigned int num = 0, slot;
+
+	list_for_each_entry(entity, entities, list)
+		num++;
+
+	idx->bits = order_base_2(num + 1) + 1;
+	idx->slots = kcalloc(1U << idx->bits, sizeof(*idx->slots),
+			GFP_KERNEL);
+	if (!idx->slots)
+		return -ENOMEM;
+
+	/* first entity wins on duplicate nodes, as the list walk did */
+	list_for_each_entry(entity, entities, list) {
+		slot = tegra_vi_graph_index_slot(idx, entity->node);
+		if (!idx->slots[slot])
+			idx->slots[slot] = entity;
+	}
+
+	return 0;
+}
+
+void my_tegra_vi_graph_index_free(struct tegra_vi_graph_index *idx)
+{
+	kfree(idx->slots);
+	idx->slots = NULL;
+}
+
+struct tegra_vi_graph_entity *
+my_tegra_vi_graph_find_entity(struct tegra_vi_graph_index *idx,
+		const struct device_node *node)
+{
+	return idx->slots[tegra_vi_graph_index_slot(idx, node)];
+}
+
+
+
+/*
+ * Resolved topology of every channel, exported as JSON through debugfs.
+ * Entities are snapshotted after each (re)build and links are recorded as
+ * they are created, with the endpoint parse result and timings, so the
+ * reader never touches entities that may be unbinding.
+ */
+#define TEGRA_VI_GRAPH_TOPO_NAME	64
+#define TEGRA_VI_GRAPH_TOPO_PADS	8
+#define TEGRA_VI_GRAPH_TOPO_PATH	128
+
+struct tegra_vi_graph_entity_rec {
+	char node[TEGRA_VI_GRAPH_TOPO_PATH];
+	char name[TEGRA_VI_GRAPH_TOPO_NAME];
+	bool bound;
+	u16 num_pads;
+	unsigned long pad_flags[TEGRA_VI_GRAPH_TOPO_PADS];
+};
+
+struct tegra_vi_graph_link_rec {
+	char ep[TEGRA_VI_GRAPH_TOPO_PATH];
+	char remote_node[TEGRA_VI_GRAPH_TOPO_PATH];
+	char source[TEGRA_VI_GRAPH_TOPO_NAME];
+	char sink[TEGRA_VI_GRAPH_TOPO_NAME];
+	u32 source_pad;
+	u32 sink_pad;
+	u32 local_port;
+	u32 remote_port;
+	u32 flags;
+	int parse_ret;
+	int ret;
+	s64 parse_ns;
+	s64 create_ns;
+};
+
+struct tegra_vi_graph_topo {
+	struct list_head list;
+	struct tegra_channel *chan;
+	char video[TEGRA_VI_GRAPH_TOPO_NAME];
+	s64 build_ns;
+	unsigned int num_entities;
+	struct tegra_vi_graph_entity_rec *entities;
+	unsigned int num_links;
+	unsigned int max_links;
+	struct tegra_vi_graph_link_rec *links;
+};
+
+static LIST_HEAD(tegra_vi_graph_topos);
+static DEFINE_MUTEX(tegra_vi_graph_topo_lock);
+
+static void tegra_vi_graph_topo_path(char *buf, size_t size,
+				     const struct device_node *node)
+{
+	if (!node)
+		buf[0] = '\0';
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	else
+		snprintf(buf, size, "%pOF", node);
+#else
+	else
+		strscpy(buf, node->full_name, size);
+#endif
+}
+
+/* called with tegra_vi_graph_topo_lock held */
+static struct tegra_vi_graph_topo *
+tegra_vi_graph_topo_get(struct tegra_channel *chan)
+{
+	struct tegra_vi_graph_topo *topo;
+
+	list_for_each_entry(topo, &tegra_vi_graph_topos, list)
+		if (topo->chan == chan)
+			return topo;
+
+	topo = kzalloc(sizeof(*topo), GFP_KERNEL);
+	if (!topo)
+		return NULL;
+	topo->chan = chan;
+	list_add_tail(&topo->list, &tegra_vi_graph_topos);
+
+	return topo;
+}
+
+/* forget the links of a channel ahead of a full build */
+static void tegra_vi_graph_topo_reset(struct tegra_channel *chan)
+{
+	struct tegra_vi_graph_topo *topo;
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	topo = tegra_vi_graph_topo_get(chan);
+	if (topo) {
+		topo->num_links = 0;
+		topo->build_ns = 0;
+	}
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+}
+
+/* forget the links of an entity that unbound or is being relinked */
+static void tegra_vi_graph_topo_drop(struct tegra_channel *chan,
+				     const char *name)
+{
+	struct tegra_vi_graph_topo *topo;
+	unsigned int i, n = 0;
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	topo = tegra_vi_graph_topo_get(chan);
+	for (i = 0; topo && i < topo->num_links; i++) {
+		struct tegra_vi_graph_link_rec *rec = &topo->links[i];
+
+		if (!strcmp(rec->source, name) || !strcmp(rec->sink, name))
+			continue;
+		topo->links[n++] = *rec;
+	}
+	if (topo)
+		topo->num_links = n;
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+}
+
+static void tegra_vi_graph_topo_record(struct tegra_channel *chan,
+				       struct tegra_vi_graph_link_rec *rec)
+{
+	struct tegra_vi_graph_topo *topo;
+	struct tegra_vi_graph_link_rec *links;
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	topo = tegra_vi_graph_topo_get(chan);
+	if (!topo)
+		goto out;
+
+	if (topo->num_links == topo->max_links) {
+		unsigned int max = topo->max_links ? topo->max_links * 2 : 8;
+
+		links = krealloc(topo->links, max * sizeof(*links),
+				GFP_KERNEL);
+		if (!links)
+			goto out;
+		topo->links = links;
+		topo->max_links = max;
+	}
+
+	topo->links[topo->num_links++] = *rec;
+out:
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+}
+
+static void tegra_vi_graph_topo_fill(struct tegra_vi_graph_entity_rec *rec,
+				     struct device_node *node,
+				     struct media_entity *entity)
+{
+	unsigned int i;
+
+	tegra_vi_graph_topo_path(rec->node, sizeof(rec->node), node);
+	rec->bound = entity != NULL;
+	if (!entity)
+		return;
+
+	strscpy(rec->name, entity->name, sizeof(rec->name));
+	rec->num_pads = min_t(u16, entity->num_pads,
+			TEGRA_VI_GRAPH_TOPO_PADS);
+	for (i = 0; i < rec->num_pads; i++)
+		rec->pad_flags[i] = entity->pads[i].flags;
+}
+
+/*
+ * Snapshot the channel's entities and pads. @gone is an entity that is
+ * unbinding and is reported as unbound.
+ */
+static void tegra_vi_graph_topo_snapshot(struct tegra_channel *chan,
+					 struct media_entity *gone)
+{
+	struct tegra_vi_graph_entity *entity;
+	struct tegra_vi_graph_entity_rec *recs;
+	struct tegra_vi_graph_topo *topo;
+	unsigned int num = 1;
+
+	list_for_each_entry(entity, &chan->entities, list)
+		num++;
+
+	recs = kcalloc(num, sizeof(*recs), GFP_KERNEL);
+	if (!recs)
+		return;
+
+	num = 0;
+	tegra_vi_graph_topo_fill(&recs[num++], chan->endpoint_node,
+			&chan->video->entity);
+	list_for_each_entry(entity, &chan->entities, list) {
+		struct media_entity *me = entity->entity;
+
+		tegra_vi_graph_topo_fill(&recs[num++], entity->node,
+				me == gone ? NULL : me);
+	}
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	topo = tegra_vi_graph_topo_get(chan);
+	if (topo) {
+		kfree(topo->entities);
+		strscpy(topo->video, chan->video->name, sizeof(topo->video));
+		topo->entities = recs;
+		topo->num_entities = num;
+		recs = NULL;
+	}
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+
+	kfree(recs);
+}
+
+static void tegra_vi_graph_topo_build_done(struct tegra_channel *chan,
+					   ktime_t start)
+{
+	struct tegra_vi_graph_topo *topo;
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	topo = tegra_vi_graph_topo_get(chan);
+	if (topo)
+		topo->build_ns = ns;
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+
+	tegra_vi_graph_topo_snapshot(chan, NULL);
+}
+
+static void tegra_vi_graph_topo_str(struct seq_file *s, const char *str)
 {
-       struct tegra_vi_graph_entity *entity;
+	seq_putc(s, '"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			seq_putc(s, '\\');
+		if ((unsigned char)*str < 0x20)
+			seq_printf(s, "\\u%04x", *str);
+		else
+			seq_putc(s, *str);
+	}
+	seq_putc(s, '"');
+}
+
+static void tegra_vi_graph_topo_node(struct seq_file *s, const char *path)
+{
+	if (path[0])
+		tegra_vi_graph_topo_str(s, path);
+	else
+		seq_puts(s, "null");
+}
 
-       list_for_each_entry(entity, &chan->entities, list) {
-               if (entity->node == node)
-                       return entity;
-       }
+static void tegra_vi_graph_topo_show_one(struct seq_file *s,
+					 struct tegra_vi_graph_topo *topo)
+{
+	unsigned int i, j;
+
+	seq_puts(s, "{\"video\":");
+	tegra_vi_graph_topo_str(s, topo->video);
+	seq_printf(s, ",\"build_ns\":%lld,\"entities\":[", topo->build_ns);
+	for (i = 0; i < topo->num_entities; i++) {
+		struct tegra_vi_graph_entity_rec *ent = &topo->entities[i];
+
+		seq_puts(s, i ? ",{\"name\":" : "{\"name\":");
+		tegra_vi_graph_topo_str(s, ent->name);
+		seq_puts(s, ",\"node\":");
+		tegra_vi_graph_topo_node(s, ent->node);
+		seq_printf(s, ",\"bound\":%s,\"pads\":[",
+			ent->bound ? "true" : "false");
+		for (j = 0; j < ent->num_pads; j++)
+			seq_printf(s, "%s{\"index\":%u,\"dir\":\"%s\"}",
+				j ? "," : "", j,
+				ent->pad_flags[j] & MEDIA_PAD_FL_SINK ?
+					"sink" : "source");
+		seq_puts(s, "]}");
+	}
 
-       return NULL;
+	seq_puts(s, "],\"links\":[");
+	for (i = 0; i < topo->num_links; i++) {
+		struct tegra_vi_graph_link_rec *rec = &topo->links[i];
+
+		seq_puts(s, i ? ",{\"endpoint\":" : "{\"endpoint\":");
+		tegra_vi_graph_topo_node(s, rec->ep);
+		seq_printf(s, ",\"parse\":{\"ret\":%d,\"local_port\":%u,"
+			"\"remote_port\":%u,\"remote_node\":",
+			rec->parse_ret, rec->local_port, rec->remote_port);
+		tegra_vi_graph_topo_node(s, rec->remote_node);
+		seq_printf(s, ",\"ns\":%lld},\"source\":", rec->parse_ns);
+		tegra_vi_graph_topo_str(s, rec->source);
+		seq_printf(s, ",\"source_pad\":%u,\"sink\":", rec->source_pad);
+		tegra_vi_graph_topo_str(s, rec->sink);
+		seq_printf(s, ",\"sink_pad\":%u,\"flags\":%u,\"ret\":%d,"
+			"\"create_ns\":%lld}",
+			rec->sink_pad, rec->flags, rec->ret, rec->create_ns);
+	}
+	seq_puts(s, "]}");
 }
 
+static int tegra_vi_graph_topo_show(struct seq_file *s, void *data)
+{
+	struct tegra_vi_graph_topo *topo;
+	bool first = true;
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	seq_puts(s, "{\"channels\":[");
+	list_for_each_entry(topo, &tegra_vi_graph_topos, list) {
+		if (!first)
+			seq_putc(s, ',');
+		first = false;
+		tegra_vi_graph_topo_show_one(s, topo);
+	}
+	seq_puts(s, "]}\n");
+	mutex_unlock(&tegra_vi_graph_topo_lock);
 
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tegra_vi_graph_topo);
+
+static const struct file_operations tegra_vi_fops_hist_fops;
+
+void my_tegra_vi_graph_debugfs_init(struct dentry *root)
+{
+	debugfs_create_file("topology", 0444, root, NULL,
+			&tegra_vi_graph_topo_fops);
+	debugfs_create_file("vi_fops_latency", 0644, root, NULL,
+			&tegra_vi_fops_hist_fops);
+}
+
+void my_tegra_vi_graph_topo_free_all(void)
+{
+	struct tegra_vi_graph_topo *topo, *tmp;
+
+	mutex_lock(&tegra_vi_graph_topo_lock);
+	list_for_each_entry_safe(topo, tmp, &tegra_vi_graph_topos, list) {
+		kfree(topo->entities);
+		kfree(topo->links);
+		list_del(&topo->list);
+		kfree(topo);
+	}
+	mutex_unlock(&tegra_vi_graph_topo_lock);
+}
 
 static int tegra_vi_graph_build_one(struct tegra_channel *chan,
+				    struct tegra_vi_graph_index *idx,
 				    struct tegra_vi_graph_entity *entity)
 {
 	u32 link_flags = MEDIA_LNK_FL_ENABLED;
@@ -184,6 +568,8 @@ static int tegra_vi_graph_build_one(struct tegra_channel *chan,
 #endif
 	struct device_node *ep = NULL;
 	struct device_node *next;
+	struct tegra_vi_graph_link_rec rec;
+	ktime_t start;
 	int ret = 0;
 
 	if (!entity->subdev) {
@@ -202,26 +588,43 @@ static int tegra_vi_graph_build_one(struct tegra_channel *chan,
 			break;
 
 		ep = next;
+		memset(&rec, 0, sizeof(rec));
+		tegra_vi_graph_topo_path(rec.ep, sizeof(rec.ep), ep);
+		strscpy(rec.source, local->name, sizeof(rec.source));
 
+		start = ktime_get();
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 		dev_dbg(chan->vi->dev, "processing endpoint %pOF\n",
 				ep);
 		ret = v4l2_fwnode_parse_link(of_fwnode_handle(ep), &link);
+		rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 		if (ret < 0) {
 			dev_err(chan->vi->dev,
 			"failed to parse link for %pOF\n", ep);
+			rec.parse_ret = rec.ret = ret;
+			tegra_vi_graph_topo_record(chan, &rec);
 			continue;
 		}
+		tegra_vi_graph_topo_path(rec.remote_node,
+				sizeof(rec.remote_node),
+				to_of_node(link.remote_node));
 #else
 		dev_dbg(chan->vi->dev, "processing endpoint %s\n",
 				ep->full_name);
 		ret = v4l2_of_parse_link(ep, &link);
+		rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 		if (ret < 0) {
 			dev_err(chan->vi->dev, "failed to parse link for %s\n",
 				ep->full_name);
+			rec.parse_ret = rec.ret = ret;
+			tegra_vi_graph_topo_record(chan, &rec);
 			continue;
 		}
+		tegra_vi_graph_topo_path(rec.remote_node,
+				sizeof(rec.remote_node), link.remote_node);
 #endif
+		rec.local_port = link.local_port;
+		rec.remote_port = link.remote_port;
 
 		if (link.local_port >= local->num_pads) {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
@@ -276,9 +679,9 @@ static int tegra_vi_graph_build_one(struct tegra_channel *chan,
 
 		/* Find the remote entity. */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
-		ent = tegra_vi_graph_find_entity(chan, to_of_node(link.remote_node));
+		ent = my_tegra_vi_graph_find_entity(idx, to_of_node(link.remote_node));
 #else
-		ent = tegra_vi_graph_find_entity(chan, link.remote_node);
+		ent = my_tegra_vi_graph_find_entity(idx, link.remote_node);
 #endif
 		if (ent == NULL) {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
@@ -323,8 +726,16 @@ static int tegra_vi_graph_build_one(struct tegra_channel *chan,
 			local->name, local_pad->index,
 			remote->name, remote_pad->index);
 
+		start = ktime_get();
 		ret = tegra_media_create_link(local, local_pad->index, remote,
 				remote_pad->index, link_flags);
+		rec.create_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		strscpy(rec.sink, remote->name, sizeof(rec.sink));
+		rec.source_pad = local_pad->index;
+		rec.sink_pad = remote_pad->index;
+		rec.flags = link_flags;
+		rec.ret = ret;
+		tegra_vi_graph_topo_record(chan, &rec);
 		if (ret < 0) {
 			dev_err(chan->vi->dev,
 				"failed to create %s:%u -> %s:%u link\n",
@@ -337,7 +748,8 @@ static int tegra_vi_graph_build_one(struct tegra_channel *chan,
 	return ret;
 }
 
-static int tegra_vi_graph_build_links(struct tegra_channel *chan)
+static int tegra_vi_graph_build_links(struct tegra_channel *chan,
+				      struct tegra_vi_graph_index *idx)
 {
 	u32 link_flags = MEDIA_LNK_FL_ENABLED;
 	struct media_entity *source;
@@ -351,6 +763,8 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 	struct v4l2_of_link link;
 #endif
 	struct device_node *ep = NULL;
+	struct tegra_vi_graph_link_rec rec = { };
+	ktime_t start;
 	int ret = 0;
 
 	dev_dbg(chan->vi->dev, "creating links for channels\n");
@@ -360,11 +774,17 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 		return -EINVAL;
 
 	ep = chan->endpoint_node;
+	tegra_vi_graph_topo_path(rec.ep, sizeof(rec.ep), ep);
+	strscpy(rec.sink, chan->video->name, sizeof(rec.sink));
 
+	start = ktime_get();
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 	dev_dbg(chan->vi->dev, "processing endpoint %pOF\n", ep);
 	ret = v4l2_fwnode_parse_link(of_fwnode_handle(ep), &link);
+	rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 	if (ret < 0) {
+		rec.parse_ret = rec.ret = ret;
+		tegra_vi_graph_topo_record(chan, &rec);
 		dev_err(chan->vi->dev, "failed to parse link for %pOF\n",
 			ep);
 		return -EINVAL;
@@ -372,7 +792,10 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 #else
 	dev_dbg(chan->vi->dev, "processing endpoint %s\n", ep->full_name);
 	ret = v4l2_of_parse_link(ep, &link);
+	rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 	if (ret < 0) {
+		rec.parse_ret = rec.ret = ret;
+		tegra_vi_graph_topo_record(chan, &rec);
 		dev_err(chan->vi->dev, "failed to parse link for %s\n",
 			ep->full_name);
 		return -EINVAL;
@@ -395,7 +818,7 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 
 	/* Find the remote entity. */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
-	ent = tegra_vi_graph_find_entity(chan, to_of_node(link.remote_node));
+	ent = my_tegra_vi_graph_find_entity(idx, to_of_node(link.remote_node));
 	if (ent == NULL) {
 		dev_err(chan->vi->dev, "no entity found for %pOF\n",
 			to_of_node(link.remote_node));
@@ -403,7 +826,7 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 		return -EINVAL;
 	}
 #else
-	ent = tegra_vi_graph_find_entity(chan, link.remote_node);
+	ent = my_tegra_vi_graph_find_entity(idx, link.remote_node);
 	if (ent == NULL) {
 		dev_err(chan->vi->dev, "no entity found for %s\n",
 			link.remote_node->full_name);
@@ -427,6 +850,15 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 
 	source = ent->entity;
 	source_pad = &source->pads[link.remote_port];
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	tegra_vi_graph_topo_path(rec.remote_node, sizeof(rec.remote_node),
+			to_of_node(link.remote_node));
+#else
+	tegra_vi_graph_topo_path(rec.remote_node, sizeof(rec.remote_node),
+			link.remote_node);
+#endif
+	rec.local_port = link.local_port;
+	rec.remote_port = link.remote_port;
 	sink = &chan->video->entity;
 	sink_pad = &chan->pad;
 
@@ -441,9 +873,17 @@ static int tegra_vi_graph_build_links(struct tegra_channel *chan)
 		source->name, source_pad->index,
 		sink->name, sink_pad->index);
 
+	start = ktime_get();
 	ret = tegra_media_create_link(source, source_pad->index,
 				       sink, sink_pad->index,
 				       link_flags);
+	rec.create_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	strscpy(rec.source, source->name, sizeof(rec.source));
+	rec.source_pad = source_pad->index;
+	rec.sink_pad = sink_pad->index;
+	rec.flags = link_flags;
+	rec.ret = ret;
+	tegra_vi_graph_topo_record(chan, &rec);
 	if (ret < 0) {
 		dev_err(chan->vi->dev,
 			"failed to create %s:%u -> %s:%u link\n",
@@ -484,7 +924,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 				err = tegra_csi_tpg_set_gain(sd, &(ctrl->val));
 			}
 		}
-		printk("s_ctrl: csi %p\n", chan->vi->csi);
+		hotlog_dbg("s_ctrl: csi %p\n", chan->vi->csi);
 		break;
 	case TEGRA_CAMERA_CID_VI_BYPASS_MODE:
 		/*
@@ -499,7 +939,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 		} else
 			chan->bypass = false;
 		*/
-		printk("s_ctrl: bypass\n");
+		hotlog_dbg("s_ctrl: bypass\n");
 		break;
 	case TEGRA_CAMERA_CID_OVERRIDE_ENABLE:    //
 		{
@@ -507,7 +947,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 			struct camera_common_data *s_data =
 				to_camera_common_data(sd->dev);
 
-			printk("s_ctrl: overrride\n");
+			hotlog_dbg("s_ctrl: overrride\n");
 			if (!s_data)
 				break;
 			if (switch_ctrl_qmenu[ctrl->val] == SWITCH_ON) {
@@ -522,7 +962,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 		}
 		break;
 	case TEGRA_CAMERA_CID_VI_HEIGHT_ALIGN: //
-		printk("s_ctrl: height align\n");
+		hotlog_dbg("s_ctrl: height align\n");
 /*
 		chan->height_align = ctrl->val;
 		tegra_channel_update_format(chan, chan->format.width,
@@ -532,7 +972,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 		*/
 		break;
 	case TEGRA_CAMERA_CID_VI_SIZE_ALIGN:
-		printk("s_ctrl: size align\n");
+		hotlog_dbg("s_ctrl: size align\n");
 		/*
 		chan->size_align = size_align_ctrl_qmenu[ctrl->val];
 		tegra_channel_update_format(chan, chan->format.width,
@@ -542,11 +982,11 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 				*/
 		break;
 	case TEGRA_CAMERA_CID_LOW_LATENCY:  //
-		printk("s_ctrl: low_latency\n");
+		hotlog_dbg("s_ctrl: low_latency\n");
 		chan->low_latency = ctrl->val;
 		break;
 	case TEGRA_CAMERA_CID_VI_PREFERRED_STRIDE:  //
-		printk("fmtinfo %p",chan->fmtinfo);
+		hotlog_dbg("s_ctrl: fmtinfo %p\n",chan->fmtinfo);
 		/*
 		chan->preferred_stride = ctrl->val;
 		tegra_channel_update_format(chan, chan->format.width,
@@ -558,7 +998,7 @@ static int my_tegra_channel_s_ctrl(struct v4l2_ctrl *ctrl){
 		*/
 		break;
 	default:
-		printk("s_ctrl: Invalid ctrl\n");
+		hotlog_warn("s_ctrl: invalid ctrl 0x%x\n", ctrl->id);
 		dev_err(&chan->video->dev, "%s: Invalid ctrl %u\n",
 			__func__, ctrl->id);
 		err = -EINVAL;
@@ -634,8 +1074,9 @@ static int my__v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
 		struct v4l2_ctrl *master = ctrl->cluster[0];
 		int i;
 
-		printk("1: ctrl %p type %d ops %p master %p controls %d\n", ctrl, ctrl->type,
-			ctrl->ops, master, master->ncontrols);
+		/* ops is logged at 2: */
+		hotlog_dbg("1: ctrl %p type %d master %p controls %d\n", ctrl,
+			ctrl->type, master, master->ncontrols);
 
 		/* Skip if this control was already handled by a cluster. */
 		/* Skip button controls and read-only controls. */
@@ -643,7 +1084,7 @@ static int my__v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
 		    (ctrl->flags & V4L2_CTRL_FLAG_READ_ONLY))
 			continue;
 
-		printk("2: ops %p master %p controls %d %p\n", ctrl->ops, master, master->ncontrols,
+		hotlog_dbg("2: ops %p master %p controls %d %p\n", ctrl->ops, master, master->ncontrols,
 				ctrl->ops->s_ctrl);
 
 		for (i = 0; i < master->ncontrols; i++) {
@@ -653,9 +1094,8 @@ static int my__v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
 				master->cluster[i]->done = true;
 			}
 		}
-		printk("3: ops %p master %p controls %d %p\n", ctrl->ops, master, master->ncontrols,
+		hotlog_dbg("3: ops %p master %p controls %d %p\n", ctrl->ops, master, master->ncontrols,
 				ctrl->ops->s_ctrl);
-		printk("my__v4l2_ctrl_handler_setup %p, %p\n", my__v4l2_ctrl_handler_setup, ctrl->ops->s_ctrl);
 
 		my_tegra_channel_s_ctrl(master); //TODO? will this be called?
 
@@ -677,21 +1117,284 @@ static int my__v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
 }
 
 
-static int (*prev_vi_add_ctrls)(struct tegra_channel *chan);
+/*
+ * Per-channel latency histograms of the vendor tegra_vi_fops, read and
+ * reset through debugfs "vi_fops_latency". Slots are indexed by chan->id,
+ * so a channel that is torn down and probed again reuses its slot.
+ */
+#define TEGRA_VI_FOPS_HIST_CHANNELS	16
+/* log2 buckets: bucket 0 counts zero, bucket n counts [2^(n-1), 2^n) ns */
+#define TEGRA_VI_FOPS_HIST_BUCKETS	32
+
+enum tegra_vi_fops_op {
+	TEGRA_VI_FOPS_POWER_ON,
+	TEGRA_VI_FOPS_START_STREAMING,
+	TEGRA_VI_FOPS_STOP_STREAMING,
+	TEGRA_VI_FOPS_SETUP_QUEUE,
+	TEGRA_VI_FOPS_ERROR_RECOVER,
+	TEGRA_VI_FOPS_ADD_CTRLS,
+	TEGRA_VI_FOPS_INIT_VIDEO_FORMATS,
+	TEGRA_VI_FOPS_NUM,
+};
+
+static const char * const tegra_vi_fops_names[TEGRA_VI_FOPS_NUM] = {
+	[TEGRA_VI_FOPS_POWER_ON] = "vi_power_on",
+	[TEGRA_VI_FOPS_START_STREAMING] = "vi_start_streaming",
+	[TEGRA_VI_FOPS_STOP_STREAMING] = "vi_stop_streaming",
+	[TEGRA_VI_FOPS_SETUP_QUEUE] = "vi_setup_queue",
+	[TEGRA_VI_FOPS_ERROR_RECOVER] = "vi_error_recover",
+	[TEGRA_VI_FOPS_ADD_CTRLS] = "vi_add_ctrls",
+	[TEGRA_VI_FOPS_INIT_VIDEO_FORMATS] = "vi_init_video_formats",
+};
+
+struct tegra_vi_fops_hist {
+	int claimed;
+	/* copied on claim, the reader never dereferences a channel */
+	char name[TEGRA_VI_GRAPH_TOPO_NAME];
+	atomic64_t buckets[TEGRA_VI_FOPS_NUM][TEGRA_VI_FOPS_HIST_BUCKETS];
+	atomic64_t max_ns[TEGRA_VI_FOPS_NUM];
+};
+
+static struct tegra_vi_fops_hist tegra_vi_fops_hists[TEGRA_VI_FOPS_HIST_CHANNELS];
+
+static struct tegra_vi_fops_hist *
+tegra_vi_fops_hist_get(struct tegra_channel *chan)
+{
+	struct tegra_vi_fops_hist *hist;
+
+	if (chan->id >= TEGRA_VI_FOPS_HIST_CHANNELS)
+		return NULL;
+
+	hist = &tegra_vi_fops_hists[chan->id];
+	if (READ_ONCE(hist->claimed))
+		return hist;
+	if (cmpxchg(&hist->claimed, 0, 1) != 0)
+		return hist;
+
+	if (chan->video)
+		snprintf(hist->name, sizeof(hist->name), "%s",
+			chan->video->name);
+	else
+		snprintf(hist->name, sizeof(hist->name), "chan%u", chan->id);
+
+	return hist;
+}
+
+/* histogram and event ring entry for one callback return */
+static void tegra_vi_fops_record(struct tegra_channel *chan,
+		enum tegra_vi_fops_op op, u64 start_ns, int ret)
+{
+	s64 ns = ktime_get_ns() - start_ns;
+	struct tegra_vi_fops_hist *hist;
+	s64 max, old;
+
+	BUILD_BUG_ON(EVRING_EV_VI_INIT_VIDEO_FORMATS - EVRING_EV_VI_POWER_ON !=
+			TEGRA_VI_FOPS_INIT_VIDEO_FORMATS);
+	evring_emit(chan->id, EVRING_EV_VI_POWER_ON + op, ns, ret);
+
+	hist = tegra_vi_fops_hist_get(chan);
+	if (!hist)
+		return;
+
+	atomic64_inc(&hist->buckets[op][min_t(int, fls64(ns),
+			TEGRA_VI_FOPS_HIST_BUCKETS - 1)]);
+	max = atomic64_read(&hist->max_ns[op]);
+	while (ns > max) {
+		old = atomic64_cmpxchg(&hist->max_ns[op], max, ns);
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+static int tegra_vi_fops_hist_show(struct seq_file *s, void *data)
+{
+	struct tegra_vi_fops_hist *hist;
+	u64 count, n;
+	int i, op, b;
+
+	for (i = 0; i < TEGRA_VI_FOPS_HIST_CHANNELS; i++) {
+		hist = &tegra_vi_fops_hists[i];
+		if (!READ_ONCE(hist->claimed))
+			continue;
+
+		for (op = 0; op < TEGRA_VI_FOPS_NUM; op++) {
+			count = 0;
+			for (b = 0; b < TEGRA_VI_FOPS_HIST_BUCKETS; b++)
+				count += atomic64_read(&hist->buckets[op][b]);
+			if (!count)
+				continue;
+
+			seq_printf(s, "%s %s count %llu max_ns %lld\n",
+				hist->name, tegra_vi_fops_names[op], count,
+				(s64)atomic64_read(&hist->max_ns[op]));
+			for (b = 0; b < TEGRA_VI_FOPS_HIST_BUCKETS; b++) {
+				n = atomic64_read(&hist->buckets[op][b]);
+				if (n)
+					seq_printf(s, "  < %12llu ns %10llu\n",
+						b ? 1ULL << b : 1ULL, n);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int tegra_vi_fops_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tegra_vi_fops_hist_show, inode->i_private);
+}
+
+/* any write clears every histogram, the channel slots are kept */
+static ssize_t tegra_vi_fops_hist_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct tegra_vi_fops_hist *hist;
+	int i, op, b;
+
+	for (i = 0; i < TEGRA_VI_FOPS_HIST_CHANNELS; i++) {
+		hist = &tegra_vi_fops_hists[i];
+		for (op = 0; op < TEGRA_VI_FOPS_NUM; op++) {
+			for (b = 0; b < TEGRA_VI_FOPS_HIST_BUCKETS; b++)
+				atomic64_set(&hist->buckets[op][b], 0);
+			atomic64_set(&hist->max_ns[op], 0);
+		}
+	}
+
+	return count;
+}
+
+static const struct file_operations tegra_vi_fops_hist_fops = {
+	.owner = THIS_MODULE,
+	.open = tegra_vi_fops_hist_open,
+	.read = seq_read,
+	.write = tegra_vi_fops_hist_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* the ops pointer a vb2 queue's VI callbacks are reached through */
+#define TEGRA_VQ_FOPS(vq)						\
+	(((struct tegra_channel *)vb2_get_drv_priv(vq))->vi->fops)
+
+INTERPOSE_CB_AROUND(vi_fops, struct tegra_vi_fops, vi_power_on,
+	my_vi_power_on, int, (struct tegra_channel *chan), (chan),
+	chan->vi->fops);
+INTERPOSE_CB_AROUND(vi_fops, struct tegra_vi_fops, vi_start_streaming,
+	my_vi_start_streaming, int, (struct vb2_queue *vq, u32 count),
+	(vq, count), TEGRA_VQ_FOPS(vq));
+INTERPOSE_CB_AROUND(vi_fops, struct tegra_vi_fops, vi_stop_streaming,
+	my_vi_stop_streaming, int, (struct vb2_queue *vq), (vq),
+	TEGRA_VQ_FOPS(vq));
+INTERPOSE_CB_AROUND(vi_fops, struct tegra_vi_fops, vi_setup_queue,
+	my_vi_setup_queue, int,
+	(struct tegra_channel *chan, unsigned int *nbuffers),
+	(chan, nbuffers), chan->vi->fops);
+INTERPOSE_CB_AROUND(vi_fops, struct tegra_vi_fops, vi_error_recover,
+	my_vi_error_recover, int,
+	(struct tegra_channel *chan, bool queue_error), (chan, queue_error),
+	chan->vi->fops);
+INTERPOSE_CB_WRAP(vi_fops, struct tegra_vi_fops, vi_add_ctrls,
+	my_vi4_add_ctrls, int, (struct tegra_channel *chan), (chan),
+	chan->vi->fops);
+INTERPOSE_CB_VOID_AROUND(vi_fops, struct tegra_vi_fops,
+	vi_init_video_formats, my_vi_init_video_formats,
+	(struct tegra_channel *chan), (chan), chan->vi->fops);
+INTERPOSE_TABLE(vi_fops, struct tegra_vi_fops,
+	INTERPOSE_SLOT(vi_fops, vi_power_on),
+	INTERPOSE_SLOT(vi_fops, vi_start_streaming),
+	INTERPOSE_SLOT(vi_fops, vi_stop_streaming),
+	INTERPOSE_SLOT(vi_fops, vi_setup_queue),
+	INTERPOSE_SLOT(vi_fops, vi_error_recover),
+	INTERPOSE_SLOT(vi_fops, vi_add_ctrls),
+	INTERPOSE_SLOT(vi_fops, vi_init_video_formats));
+
+static int my_vi_power_on(struct tegra_channel *chan)
+{
+	u64 start = ktime_get_ns();
+	int ret = INTERPOSE_ORIG(vi_fops, vi_power_on,
+			chan->vi->fops)(chan);
+
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_POWER_ON, start, ret);
+	return ret;
+}
+
+/* below, with the incremental bind/unbind */
+static void tegra_vi_graph_detach_deferred(struct tegra_channel *chan);
+
+static int my_vi_start_streaming(struct vb2_queue *vq, u32 count)
+{
+	struct tegra_channel *chan = vb2_get_drv_priv(vq);
+	u64 start = ktime_get_ns();
+	int ret = INTERPOSE_ORIG(vi_fops, vi_start_streaming,
+			TEGRA_VQ_FOPS(vq))(vq, count);
+
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_START_STREAMING, start, ret);
+	return ret;
+}
+
+static int my_vi_stop_streaming(struct vb2_queue *vq)
+{
+	struct tegra_channel *chan = vb2_get_drv_priv(vq);
+	u64 start = ktime_get_ns();
+	int ret = INTERPOSE_ORIG(vi_fops, vi_stop_streaming,
+			TEGRA_VQ_FOPS(vq))(vq);
+
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_STOP_STREAMING, start, ret);
+	tegra_vi_graph_detach_deferred(chan);
+	return ret;
+}
+
+static int my_vi_setup_queue(struct tegra_channel *chan,
+		unsigned int *nbuffers)
+{
+	u64 start = ktime_get_ns();
+	int ret = INTERPOSE_ORIG(vi_fops, vi_setup_queue,
+			chan->vi->fops)(chan, nbuffers);
+
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_SETUP_QUEUE, start, ret);
+	return ret;
+}
+
+static int my_vi_error_recover(struct tegra_channel *chan, bool queue_error)
+{
+	u64 start = ktime_get_ns();
+	int ret = INTERPOSE_ORIG(vi_fops, vi_error_recover,
+			chan->vi->fops)(chan, queue_error);
+
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_ERROR_RECOVER, start, ret);
+	return ret;
+}
+
+static void my_vi_init_video_formats(struct tegra_channel *chan)
+{
+	u64 start = ktime_get_ns();
+
+	INTERPOSE_ORIG(vi_fops, vi_init_video_formats, chan->vi->fops)(chan);
+	tegra_vi_fops_record(chan, TEGRA_VI_FOPS_INIT_VIDEO_FORMATS, start, 0);
+}
 
 static int my_vi4_add_ctrls(struct tegra_channel *chan)  
 {                                                     
+	ktime_t start = ktime_get_boottime();
 	struct list_head *ctrls;
 	int i;
 
-	printk("call prev vi_add_ctrls");
-	prev_vi_add_ctrls(chan);
+	hotlog_dbg("call prev vi_add_ctrls\n");
+	if (INTERPOSE_ORIG(vi_fops, vi_add_ctrls, chan->vi->fops)) {
+		u64 start_ns = ktime_get_ns();
+		int ret = INTERPOSE_ORIG(vi_fops, vi_add_ctrls,
+				chan->vi->fops)(chan);
+
+		tegra_vi_fops_record(chan, TEGRA_VI_FOPS_ADD_CTRLS, start_ns,
+				ret);
+	}
         ctrls = &(chan->ctrl_handler.ctrls);
-	printk("my add ctrls: prev %p next %p\n", ctrls->prev, ctrls->next);
+	hotlog_dbg("my add ctrls: prev %p next %p\n", ctrls->prev, ctrls->next);
 
 
 	for (i = 0; i < chan->num_video_formats; ++i) {
-		printk("%d: videeo format %d 0x%x\n", i, chan->video_formats[i]->code,
+		hotlog_dbg("%d: video format 0x%x\n", i,
 				chan->video_formats[i]->code);
 	}
 
@@ -699,16 +1402,94 @@ static int my_vi4_add_ctrls(struct tegra_channel *chan)
 //	chan->fmtinfo = &my__tegra_default_format[0];
 //	chan->preferred_stride = 0 ;
 	my__v4l2_ctrl_handler_setup(&(chan->ctrl_handler));
-	printk("set it as empty to avoid crash\n");
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_CTRL_SETUP,
+			chan->video ? chan->video->name : NULL, start);
+	hotlog_dbg("set it as empty to avoid crash\n");
 	ctrls->prev = ctrls->next = ctrls;
 	return 0;
 }
 
-static struct tegra_vi_fops my_vi2_fops = { 
-};
+/*
+ * vb2 queue and sub-device callbacks, counted and timed only. The
+ * sub-device tables keep one shadow per sensor driver; the pad and video
+ * tables are attached inside the v4l2_subdev_ops shadow.
+ */
+INTERPOSE_CB(vb2_qops, struct vb2_ops, queue_setup, int,
+	(struct vb2_queue *vq, unsigned int *nbuffers, unsigned int *nplanes,
+		unsigned int sizes[], struct device *alloc_devs[]),
+	(vq, nbuffers, nplanes, sizes, alloc_devs), vq->ops);
+INTERPOSE_CB(vb2_qops, struct vb2_ops, buf_prepare, int,
+	(struct vb2_buffer *vb), (vb), vb->vb2_queue->ops);
+INTERPOSE_CB_VOID(vb2_qops, struct vb2_ops, buf_queue,
+	(struct vb2_buffer *vb), (vb), vb->vb2_queue->ops);
+INTERPOSE_CB(vb2_qops, struct vb2_ops, start_streaming, int,
+	(struct vb2_queue *vq, unsigned int count), (vq, count), vq->ops);
+INTERPOSE_CB_VOID(vb2_qops, struct vb2_ops, stop_streaming,
+	(struct vb2_queue *vq), (vq), vq->ops);
+INTERPOSE_TABLE(vb2_qops, struct vb2_ops,
+	INTERPOSE_SLOT(vb2_qops, queue_setup),
+	INTERPOSE_SLOT(vb2_qops, buf_prepare),
+	INTERPOSE_SLOT(vb2_qops, buf_queue),
+	INTERPOSE_SLOT(vb2_qops, start_streaming),
+	INTERPOSE_SLOT(vb2_qops, stop_streaming));
+
+INTERPOSE_TABLE(subdev_ops, struct v4l2_subdev_ops);
+
+INTERPOSE_CB(subdev_video, struct v4l2_subdev_video_ops, s_stream, int,
+	(struct v4l2_subdev *sd, int enable), (sd, enable), sd->ops->video);
+INTERPOSE_TABLE(subdev_video, struct v4l2_subdev_video_ops,
+	INTERPOSE_SLOT(subdev_video, s_stream));
+
+INTERPOSE_CB(subdev_pad, struct v4l2_subdev_pad_ops, get_fmt, int,
+	(struct v4l2_subdev *sd, struct v4l2_subdev_pad_config *cfg,
+		struct v4l2_subdev_format *format),
+	(sd, cfg, format), sd->ops->pad);
+INTERPOSE_CB(subdev_pad, struct v4l2_subdev_pad_ops, set_fmt, int,
+	(struct v4l2_subdev *sd, struct v4l2_subdev_pad_config *cfg,
+		struct v4l2_subdev_format *format),
+	(sd, cfg, format), sd->ops->pad);
+INTERPOSE_TABLE(subdev_pad, struct v4l2_subdev_pad_ops,
+	INTERPOSE_SLOT(subdev_pad, get_fmt),
+	INTERPOSE_SLOT(subdev_pad, set_fmt));
+
+/* Called from the notifier's bound and complete */
+void my_tegra_vi_graph_wrap_subdev(struct v4l2_subdev *sd)
+{
+	struct v4l2_subdev_ops *shadow;
+
+	if (!sd->ops || INTERPOSE_ATTACH(subdev_ops, &sd->ops))
+		return;
+
+	/* sub-devices of one driver share the shadow, attached already */
+	shadow = INTERPOSE_SHADOW(subdev_ops, &sd->ops);
+	if (shadow && shadow->video)
+		INTERPOSE_ATTACH(subdev_video, &shadow->video);
+	if (shadow && shadow->pad)
+		INTERPOSE_ATTACH(subdev_pad, &shadow->pad);
+}
+
+/*
+ * Called from the notifier's unbind, before anything else: the sensor
+ * module may go away right after and take the original ops with it.
+ */
+void my_tegra_vi_graph_unwrap_subdev(struct v4l2_subdev *sd)
+{
+	struct v4l2_subdev_ops *shadow;
+
+	shadow = INTERPOSE_SHADOW(subdev_ops, &sd->ops);
+	if (!shadow || INTERPOSE_DETACH(subdev_ops, &sd->ops) <= 0)
+		return;
+
+	/* the last sub-device using the shadow is gone */
+	if (shadow->video)
+		INTERPOSE_DETACH(subdev_video, &shadow->video);
+	if (shadow->pad)
+		INTERPOSE_DETACH(subdev_pad, &shadow->pad);
+}
 
 int my_tegra_vi_graph_notify_complete2(struct v4l2_async_notifier *notifier)
 {
+	struct v4l2_subdev *sd;
 #if 0
 	struct tegra_channel *chan =
 		container_of(notifier, struct tegra_channel, notifier);
@@ -724,31 +1505,34 @@ int my_tegra_vi_graph_notify_complete2(struct v4l2_async_notifier *notifier)
 		printk("ctrl %p\n", ctrl);
 		//my_tegra_channel_s_ctrl(ctrl);
 	}
-#else
+#elif defined(NVIDIA)
         struct tegra_channel *chan =
                container_of(notifier, struct tegra_channel, notifier);
         struct v4l2_ctrl_handler *ctrl_handler;
-        printk("run to complete2, jiangjqian %p\n", notifier);
-        printk("name %s\n", notifier->v4l2_dev->name);
-        printk("chan %p\n", chan);
+        hotlog_info("run to complete2, %p\n", notifier);
+        pr_debug("name %s\n", notifier->v4l2_dev->name);
+        hotlog_dbg("chan %p\n", chan);
 
 	ctrl_handler = &(chan->ctrl_handler);
-        printk("ctrl handler %p\n", ctrl_handler);
+        hotlog_dbg("ctrl handler %p\n", ctrl_handler);
 
 	//chan->fmtinfo = &my__tegra_default_format[0];
 	//chan->preferred_stride = 0 ;
-	printk("ctrls %p %p\n", ctrl_handler->ctrls.prev, ctrl_handler->ctrls.next);
+	hotlog_dbg("ctrls %p %p\n", ctrl_handler->ctrls.prev, ctrl_handler->ctrls.next);
         //ctrl_handler->ctrls.prev = &(ctrl_handler->ctrls);
         //ctrl_handler->ctrls.next = &(ctrl_handler->ctrls);
 
 	//change vi
-	prev_vi_add_ctrls = chan->vi->fops->vi_add_ctrls;
-	printk("original vi_add_ctrls %p\n", prev_vi_add_ctrls);
-	memcpy(&my_vi2_fops, chan->vi->fops, sizeof(struct tegra_vi_fops));
-	my_vi2_fops.vi_add_ctrls = my_vi4_add_ctrls;
-	chan->vi->fops = &my_vi2_fops;
-
+	hotlog_dbg("original vi_add_ctrls %p\n", chan->vi->fops->vi_add_ctrls);
+	INTERPOSE_ATTACH(vi_fops, &chan->vi->fops);
+	INTERPOSE_ATTACH(vb2_qops, &chan->queue.ops);
+#else
+	/* the fake sun6i notifier is not embedded in a tegra_channel */
+	pr_debug("complete2 %s, no VI to wrap\n", notifier->v4l2_dev->name);
 #endif
+	/* bound before the module was loaded */
+	v4l2_device_for_each_subdev(sd, notifier->v4l2_dev)
+		my_tegra_vi_graph_wrap_subdev(sd);
 
 	return 0;
 }
@@ -758,6 +1542,8 @@ int my_tegra_vi_graph_notify_complete(struct v4l2_async_notifier *notifier)
 	struct tegra_channel *chan =
 		container_of(notifier, struct tegra_channel, notifier);
 	struct tegra_vi_graph_entity *entity;
+	struct tegra_vi_graph_index idx;
+	ktime_t start;
 	int ret;
 
 	dev_dbg(chan->vi->dev, "notify complete, all subdevs registered\n");
@@ -770,28 +1556,41 @@ int my_tegra_vi_graph_notify_complete(struct v4l2_async_notifier *notifier)
 		return ret;
 	}
 
+	start = ktime_get_boottime();
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0)
 	ret = video_register_device(chan->video, VFL_TYPE_GRABBER, -1);
 #else
 	ret = video_register_device(chan->video, VFL_TYPE_VIDEO, -1);
 #endif
+	my_debug_v4l2_timeline_add(MY_DEBUG_V4L2_VIDEO_REGISTER,
+			chan->video->name, start);
 	if (ret < 0) {
 		dev_err(chan->vi->dev, "failed to register %s\n",
 			chan->video->name);
 		goto register_device_error;
 	}
 
+	ret = my_tegra_vi_graph_index_build(&chan->entities, &idx);
+	if (ret < 0)
+		goto graph_error;
+
+	tegra_vi_graph_topo_reset(chan);
+	start = ktime_get();
+
 	/* Create links for every entity. */
 	list_for_each_entry(entity, &chan->entities, list) {
 		if (entity->entity != NULL) {
-			ret = tegra_vi_graph_build_one(chan, entity);
+			ret = tegra_vi_graph_build_one(chan, &idx, entity);
 			if (ret < 0)
-				goto graph_error;
+				break;
 		}
 	}
 
 	/* Create links for channels */
-	ret = tegra_vi_graph_build_links(chan);
+	if (ret >= 0)
+		ret = tegra_vi_graph_build_links(chan, &idx);
+	my_tegra_vi_graph_index_free(&idx);
+	tegra_vi_graph_topo_build_done(chan, start);
 	if (ret < 0)
 		goto graph_error;
 
@@ -813,4 +1612,363 @@ register_device_error:
 	return ret;
 }
 
+/* -----------------------------------------------------------------------------
+ * Incremental bind/unbind
+ *
+ * Once the channel graph is up, a sub-device that unbinds and binds again
+ * (e.g. a sensor behind a deserializer) only has its own links and node
+ * recreated. The video node and the other entities stay registered.
+ *
+ * tegra_channel_detach_subdevices() is only exported by a kernel built
+ * with this tree's channel.c. It is looked up when a sub-device unbinds,
+ * so the module still loads without it and the notifier then falls back
+ * to the original full teardown.
+ */
+
+extern void tegra_channel_detach_subdevices(struct tegra_channel *chan);
+extern int tegra_channel_init_subdevices(struct tegra_channel *chan);
+
+/*
+ * channels whose detach waits for capture to stop, by chan->id. Set,
+ * tested and cleared under chan->video_lock, the vb2 queue lock, so an
+ * unbind or bind can't interleave with STREAMON/STREAMOFF.
+ */
+#define TEGRA_VI_GRAPH_DETACH_CHANNELS	64
+static DECLARE_BITMAP(tegra_vi_graph_detach_pending,
+		TEGRA_VI_GRAPH_DETACH_CHANNELS);
+
+#define TEGRA_VI_GRAPH_REBIND_SLOTS	8
+
+/* unbind time of recently unbound entities, keyed by device_node */
+static struct {
+	const struct device_node *node;
+	ktime_t unbind;
+} tegra_vi_graph_rebind[TEGRA_VI_GRAPH_REBIND_SLOTS];
+static DEFINE_SPINLOCK(tegra_vi_graph_rebind_lock);
+
+static void tegra_vi_graph_rebind_mark(const struct device_node *node)
+{
+	unsigned int slot = hash_ptr(node, ilog2(TEGRA_VI_GRAPH_REBIND_SLOTS));
+
+	spin_lock(&tegra_vi_graph_rebind_lock);
+	tegra_vi_graph_rebind[slot].node = node;
+	tegra_vi_graph_rebind[slot].unbind = ktime_get();
+	spin_unlock(&tegra_vi_graph_rebind_lock);
+}
+
+/* microseconds since @node unbound, or -1 if it was not seen unbinding */
+static s64 tegra_vi_graph_rebind_take(const struct device_node *node)
+{
+	unsigned int slot = hash_ptr(node, ilog2(TEGRA_VI_GRAPH_REBIND_SLOTS));
+	s64 us = -1;
+
+	spin_lock(&tegra_vi_graph_rebind_lock);
+	if (tegra_vi_graph_rebind[slot].node == node) {
+		us = ktime_us_delta(ktime_get(),
+				tegra_vi_graph_rebind[slot].unbind);
+		tegra_vi_graph_rebind[slot].node = NULL;
+	}
+	spin_unlock(&tegra_vi_graph_rebind_lock);
+
+	return us;
+}
+
+static struct tegra_vi_graph_entity *
+tegra_vi_graph_find_subdev(struct tegra_channel *chan,
+			   struct v4l2_subdev *subdev)
+{
+	struct tegra_vi_graph_entity *entity;
+
+	list_for_each_entry(entity, &chan->entities, list)
+		if (entity->node == subdev->dev->of_node)
+			return entity;
+
+	return NULL;
+}
+
+/*
+ * Create the links ending on @entity's sink pads from entities that are
+ * already bound. tegra_vi_graph_build_one() only walks source pads, so on
+ * a full build these come from the other end of the link.
+ */
+static int tegra_vi_graph_build_sinks(struct tegra_channel *chan,
+				      struct tegra_vi_graph_index *idx,
+				      struct tegra_vi_graph_entity *entity)
+{
+	struct media_entity *local = entity->entity;
+	struct tegra_vi_graph_entity *ent;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	struct v4l2_fwnode_link link;
+#else
+	struct v4l2_of_link link;
+#endif
+	struct device_node *ep = NULL;
+	struct tegra_vi_graph_link_rec rec;
+	struct media_pad *local_pad;
+	struct media_entity *remote;
+	ktime_t start;
+	int ret = 0;
+
+	while ((ep = of_graph_get_next_endpoint(entity->node, ep))) {
+		memset(&rec, 0, sizeof(rec));
+		tegra_vi_graph_topo_path(rec.ep, sizeof(rec.ep), ep);
+
+		start = ktime_get();
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+		if (v4l2_fwnode_parse_link(of_fwnode_handle(ep), &link) < 0)
+			continue;
+		rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		tegra_vi_graph_topo_path(rec.remote_node,
+				sizeof(rec.remote_node),
+				to_of_node(link.remote_node));
+		ent = my_tegra_vi_graph_find_entity(idx,
+				to_of_node(link.remote_node));
+#else
+		if (v4l2_of_parse_link(ep, &link) < 0)
+			continue;
+		rec.parse_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		tegra_vi_graph_topo_path(rec.remote_node,
+				sizeof(rec.remote_node), link.remote_node);
+		ent = my_tegra_vi_graph_find_entity(idx, link.remote_node);
+#endif
+		if (link.local_port >= local->num_pads ||
+		    !(local->pads[link.local_port].flags & MEDIA_PAD_FL_SINK) ||
+		    !ent || !ent->entity ||
+		    link.remote_port >= ent->entity->num_pads)
+			goto next;
+
+		local_pad = &local->pads[link.local_port];
+		remote = ent->entity;
+
+		dev_dbg(chan->vi->dev, "creating %s:%u -> %s:%u link\n",
+			remote->name, link.remote_port,
+			local->name, local_pad->index);
+
+		start = ktime_get();
+		ret = tegra_media_create_link(remote, link.remote_port,
+				local, local_pad->index, MEDIA_LNK_FL_ENABLED);
+		rec.create_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		strscpy(rec.source, remote->name, sizeof(rec.source));
+		strscpy(rec.sink, local->name, sizeof(rec.sink));
+		rec.source_pad = link.remote_port;
+		rec.sink_pad = local_pad->index;
+		rec.local_port = link.local_port;
+		rec.remote_port = link.remote_port;
+		rec.flags = MEDIA_LNK_FL_ENABLED;
+		rec.ret = ret;
+		tegra_vi_graph_topo_record(chan, &rec);
+		if (ret < 0)
+			dev_err(chan->vi->dev,
+				"failed to create %s:%u -> %s:%u link\n",
+				remote->name, link.remote_port,
+				local->name, local_pad->index);
+next:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+		v4l2_fwnode_put_link(&link);
+#else
+		v4l2_of_put_link(&link);
+#endif
+		if (ret < 0) {
+			of_node_put(ep);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/* true if @entity is the remote end of the channel's own endpoint */
+static bool tegra_vi_graph_feeds_channel(struct tegra_channel *chan,
+					 struct tegra_vi_graph_entity *entity)
+{
+	struct device_node *remote;
+	bool ret;
+
+	remote = of_graph_get_remote_port_parent(chan->endpoint_node);
+	ret = remote == entity->node;
+	of_node_put(remote);
+
+	return ret;
+}
+
+bool my_tegra_vi_graph_linked(struct v4l2_async_notifier *notifier)
+{
+	struct tegra_channel *chan =
+		container_of(notifier, struct tegra_channel, notifier);
+
+	return chan->link_status != 0;
+}
+
+static bool tegra_vi_graph_detach(struct tegra_channel *chan)
+{
+	void (*detach)(struct tegra_channel *chan);
+
+	detach = symbol_get(tegra_channel_detach_subdevices);
+	if (!detach)
+		return false;
+	detach(chan);
+	symbol_put(tegra_channel_detach_subdevices);
+
+	return true;
+}
+
+/*
+ * Drop @subdev from the channel's sub-device list right away, so nothing
+ * calls into it while capture keeps running until the deferred detach.
+ */
+static void tegra_vi_graph_forget_subdev(struct tegra_channel *chan,
+					 struct v4l2_subdev *subdev)
+{
+	int i, j;
+
+	for (i = 0, j = 0; i < chan->num_subdevs; i++)
+		if (chan->subdev[i] != subdev)
+			chan->subdev[j++] = chan->subdev[i];
+	for (i = j; i < chan->num_subdevs; i++)
+		chan->subdev[i] = NULL;
+	chan->num_subdevs = j;
+	if (chan->subdev_on_csi == subdev)
+		chan->subdev_on_csi = NULL;
+}
+
+/*
+ * Called from the stop_streaming wrapper once capture has stopped, with
+ * chan->video_lock held by vb2. Runs the detach an unbind deferred and
+ * re-attaches the channel if the path to the sensor is complete again.
+ */
+static void tegra_vi_graph_detach_deferred(struct tegra_channel *chan)
+{
+	if (chan->id >= TEGRA_VI_GRAPH_DETACH_CHANNELS ||
+	    !test_and_clear_bit(chan->id, tegra_vi_graph_detach_pending))
+		return;
+
+	tegra_vi_graph_detach(chan);
+	if (tegra_channel_init_subdevices(chan) < 0)
+		dev_dbg(chan->vi->dev, "%s: path to sensor incomplete\n",
+			chan->video->name);
+}
+
+/*
+ * Called from the notifier's unbind before the async core unregisters the
+ * sub-device, which drops the entity and all of its links. Returns true if
+ * the unbind was handled here and the original teardown must not run:
+ * the channel was detached, or, while it is streaming, @subdev was
+ * dropped and the detach deferred until capture stops.
+ */
+bool my_tegra_vi_graph_subdev_unbind(struct v4l2_async_notifier *notifier,
+				     struct v4l2_subdev *subdev)
+{
+	struct tegra_channel *chan =
+		container_of(notifier, struct tegra_channel, notifier);
+	struct tegra_vi_graph_entity *entity;
+	bool attached = false;
+	int i;
+
+	if (!chan->link_status ||
+	    chan->id >= TEGRA_VI_GRAPH_DETACH_CHANNELS ||
+	    !symbol_get(tegra_channel_detach_subdevices))
+		return false;
+	symbol_put(tegra_channel_detach_subdevices);
+
+	entity = tegra_vi_graph_find_subdev(chan, subdev);
+	if (!entity)
+		return false;
+
+	mutex_lock(&chan->video_lock);
+	for (i = 0; i < chan->num_subdevs; i++)
+		if (chan->subdev[i] == subdev)
+			attached = true;
+
+	if (attached && vb2_is_streaming(&chan->queue)) {
+		dev_warn(chan->vi->dev,
+			"%s unbound while %s is streaming, detaching on stop\n",
+			subdev->name, chan->video->name);
+		tegra_vi_graph_forget_subdev(chan, subdev);
+		set_bit(chan->id, tegra_vi_graph_detach_pending);
+	} else if (attached) {
+		tegra_vi_graph_detach(chan);
+	}
+	mutex_unlock(&chan->video_lock);
+
+	media_entity_remove_links(&subdev->entity);
+	tegra_vi_graph_topo_drop(chan, subdev->entity.name);
+	tegra_vi_graph_topo_snapshot(chan, &subdev->entity);
+	tegra_vi_graph_rebind_mark(entity->node);
 
+	/* what the original unbind does for the bound entity */
+	v4l2_device_unregister_subdev(subdev);
+	entity->subdev = NULL;
+	entity->entity = NULL;
+
+	dev_dbg(chan->vi->dev, "%s unbound, %s kept registered\n",
+		subdev->name, chan->video->name);
+
+	return true;
+}
+
+/*
+ * Called from the notifier's bound after the entity has been filled in.
+ * Recreates only the links touching the new entity and re-attaches the
+ * channel once the path to the sensor is complete again.
+ */
+int my_tegra_vi_graph_subdev_bound(struct v4l2_async_notifier *notifier,
+				   struct v4l2_subdev *subdev)
+{
+	struct tegra_channel *chan =
+		container_of(notifier, struct tegra_channel, notifier);
+	struct tegra_vi_graph_entity *entity;
+	struct tegra_vi_graph_index idx;
+	ktime_t start = ktime_get();
+	s64 since_unbind;
+	int ret;
+
+	/* the first full build happens in complete */
+	if (!chan->link_status)
+		return 0;
+
+	entity = tegra_vi_graph_find_subdev(chan, subdev);
+	if (!entity || !entity->entity)
+		return 0;
+
+	ret = my_tegra_vi_graph_index_build(&chan->entities, &idx);
+	if (ret < 0)
+		return ret;
+
+	tegra_vi_graph_topo_drop(chan, entity->entity->name);
+	ret = tegra_vi_graph_build_one(chan, &idx, entity);
+	if (ret >= 0)
+		ret = tegra_vi_graph_build_sinks(chan, &idx, entity);
+	if (ret >= 0 && tegra_vi_graph_feeds_channel(chan, entity))
+		ret = tegra_vi_graph_build_links(chan, &idx);
+	my_tegra_vi_graph_index_free(&idx);
+	tegra_vi_graph_topo_snapshot(chan, NULL);
+	if (ret < 0)
+		return ret;
+
+	ret = v4l2_device_register_subdev_nodes(&chan->vi->v4l2_dev);
+	if (ret < 0) {
+		dev_err(chan->vi->dev, "failed to register subdev nodes\n");
+		return ret;
+	}
+
+	/*
+	 * A streaming channel re-attaches once its deferred detach ran.
+	 * Not an error if the rest of the path is still unbound.
+	 */
+	mutex_lock(&chan->video_lock);
+	if ((chan->id >= TEGRA_VI_GRAPH_DETACH_CHANNELS ||
+	     !test_bit(chan->id, tegra_vi_graph_detach_pending)) &&
+	    !chan->num_subdevs && tegra_channel_init_subdevices(chan) < 0)
+		dev_dbg(chan->vi->dev, "%s: path to sensor incomplete\n",
+			chan->video->name);
+	mutex_unlock(&chan->video_lock);
+
+	since_unbind = tegra_vi_graph_rebind_take(entity->node);
+	if (since_unbind >= 0)
+		dev_info(chan->vi->dev,
+			"%s rebound after %lld us, relinked in %lld us\n",
+			subdev->name, since_unbind,
+			ktime_us_delta(ktime_get(), start));
+
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * hotlog - per-CPU binary ring behind hotlog.h
+ *
+ * debugfs files under the module root:
+ *   hotlog          all rings, struct hotlog_rec records, oldest first per CPU
+ *   hotlog_formats  "id level nargs file:line format" per registered site
+ *
+ * The rings are read without stopping writers, so a record being written
+ * while the file is opened can come out torn. That is acceptable for a
+ * debug trace and keeps the write side to a few stores.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "hotlog.h"
+
+/* per CPU, power of two */
+#define HOTLOG_RING_RECS	1024
+#define HOTLOG_MAX_FMTS		1024
+
+struct hotlog_ring {
+	unsigned int head;
+	struct hotlog_rec recs[HOTLOG_RING_RECS];
+};
+
+/* hotlog_rings is what writers see, hotlog_ring_mem owns the memory */
+static DEFINE_PER_CPU(struct hotlog_ring *, hotlog_rings);
+static DEFINE_PER_CPU(struct hotlog_ring *, hotlog_ring_mem);
+
+/*
+ * Copy of a registered call site. The strings are duplicated since the
+ * site may live in another module that unloads before this one.
+ */
+struct hotlog_site {
+	u8 level;
+	u8 nargs;
+	unsigned int line;
+	char *file;
+	char *fmt;
+};
+
+static struct hotlog_site *hotlog_sites[HOTLOG_MAX_FMTS];
+static unsigned int hotlog_num_sites;
+static DEFINE_SPINLOCK(hotlog_site_lock);
+
+static void hotlog_site_free(struct hotlog_site *site)
+{
+	if (!site)
+		return;
+	kfree(site->file);
+	kfree(site->fmt);
+	kfree(site);
+}
+
+static bool hotlog_register(struct hotlog_fmt *fmt)
+{
+	struct hotlog_site *site;
+	unsigned long flags;
+
+	/* nothing to log into before init or after exit */
+	if (!raw_cpu_read(hotlog_rings))
+		return false;
+
+	/* may run from any context the call site does */
+	site = kzalloc(sizeof(*site), GFP_ATOMIC);
+	if (!site)
+		return false;
+	site->level = fmt->level;
+	site->nargs = fmt->nargs;
+	site->line = fmt->line;
+	site->file = kstrdup(kbasename(fmt->file), GFP_ATOMIC);
+	site->fmt = kstrdup(fmt->fmt, GFP_ATOMIC);
+	if (!site->file || !site->fmt) {
+		hotlog_site_free(site);
+		return false;
+	}
+
+	spin_lock_irqsave(&hotlog_site_lock, flags);
+	if (!fmt->id && hotlog_num_sites < HOTLOG_MAX_FMTS) {
+		unsigned int n = hotlog_num_sites;
+
+		hotlog_sites[n] = site;
+		site = NULL;
+		/* publish after the table entry, ids start at 1 */
+		smp_store_release(&hotlog_num_sites, n + 1);
+		WRITE_ONCE(fmt->id, n + 1);
+	}
+	spin_unlock_irqrestore(&hotlog_site_lock, flags);
+
+	hotlog_site_free(site);
+	return READ_ONCE(fmt->id) != 0;
+}
+
+void __hotlog_write(struct hotlog_fmt *fmt, const u64 *args)
+{
+	struct hotlog_ring *ring;
+	struct hotlog_rec *rec;
+	unsigned long flags;
+	unsigned int i;
+
+	if (unlikely(!READ_ONCE(fmt->id)) && !hotlog_register(fmt))
+		return;
+
+	local_irq_save(flags);
+	ring = this_cpu_read(hotlog_rings);
+	if (likely(ring)) {
+		rec = &ring->recs[ring->head++ & (HOTLOG_RING_RECS - 1)];
+		rec->ts_ns = local_clock();
+		rec->id = fmt->id;
+		rec->nargs = fmt->nargs;
+		rec->level = fmt->level;
+		rec->cpu = smp_processor_id();
+		for (i = 0; i < fmt->nargs; i++)
+			rec->args[i] = args[i];
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(__hotlog_write);
+
+struct hotlog_snapshot {
+	size_t size;
+	struct hotlog_rec recs[];
+};
+
+static int hotlog_open(struct inode *inode, struct file *file)
+{
+	struct hotlog_snapshot *snap;
+	struct hotlog_ring *ring;
+	unsigned int head, n, i;
+	size_t num = 0;
+	int cpu;
+
+	snap = kvzalloc(struct_size(snap, recs,
+			num_possible_cpus() * HOTLOG_RING_RECS), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu(hotlog_rings, cpu);
+		if (!ring)
+			continue;
+
+		head = READ_ONCE(ring->head);
+		n = min_t(unsigned int, head, HOTLOG_RING_RECS);
+		for (i = head - n; i != head; i++) {
+			struct hotlog_rec *rec =
+				&ring->recs[i & (HOTLOG_RING_RECS - 1)];
+
+			if (rec->id)
+				snap->recs[num++] = *rec;
+		}
+	}
+	snap->size = num * sizeof(struct hotlog_rec);
+	file->private_data = snap;
+
+	return 0;
+}
+
+static ssize_t hotlog_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct hotlog_snapshot *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->recs,
+			snap->size);
+}
+
+static int hotlog_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations hotlog_fops = {
+	.owner = THIS_MODULE,
+	.open = hotlog_open,
+	.read = hotlog_read,
+	.release = hotlog_release,
+	.llseek = default_llseek,
+};
+
+static int hotlog_formats_show(struct seq_file *s, void *data)
+{
+	unsigned int i, num;
+	const char *p;
+
+	num = smp_load_acquire(&hotlog_num_sites);
+	for (i = 0; i < num; i++) {
+		struct hotlog_site *fmt = hotlog_sites[i];
+
+		seq_printf(s, "%u %u %u %s:%u ", i + 1, fmt->level,
+			fmt->nargs, fmt->file, fmt->line);
+		/* one site per line, escape the format's own newlines */
+		for (p = fmt->fmt; *p; p++) {
+			if (*p == '\n')
+				seq_puts(s, "\\n");
+			else if (*p == '\\')
+				seq_puts(s, "\\\\");
+			else
+				seq_putc(s, *p);
+		}
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hotlog_formats);
+
+int hotlog_init(struct dentry *root)
+{
+	struct hotlog_ring *ring;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = vzalloc(sizeof(*ring));
+		if (!ring) {
+			hotlog_exit();
+			return -ENOMEM;
+		}
+		per_cpu(hotlog_ring_mem, cpu) = ring;
+		per_cpu(hotlog_rings, cpu) = ring;
+	}
+
+	if (root) {
+		debugfs_create_file("hotlog", 0400, root, NULL, &hotlog_fops);
+		debugfs_create_file("hotlog_formats", 0444, root, NULL,
+				&hotlog_formats_fops);
+	}
+
+	return 0;
+}
+
+void hotlog_exit(void)
+{
+	unsigned int i;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		WRITE_ONCE(per_cpu(hotlog_rings, cpu), NULL);
+	/* writers run with interrupts off, this waits them out */
+	synchronize_rcu();
+	for_each_possible_cpu(cpu) {
+		vfree(per_cpu(hotlog_ring_mem, cpu));
+		per_cpu(hotlog_ring_mem, cpu) = NULL;
+	}
+
+	for (i = 0; i < hotlog_num_sites; i++)
+		hotlog_site_free(hotlog_sites[i]);
+	hotlog_num_sites = 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * hotlog - compile-time levelled binary logging for hot paths
+ *
+ * A hotlog call stores a format id and up to HOTLOG_MAX_ARGS integer or
+ * pointer arguments in a per-CPU ring instead of formatting through
+ * printk, so it never waits on the console. hotlog_decode.c turns the
+ * rings back into text using the format table exported next to them.
+ *
+ * Levels above HOTLOG_LEVEL compile to nothing: their arguments are not
+ * evaluated and no format is emitted. HOTLOG_LEVEL is per translation
+ * unit, define it before including this header to change it.
+ *
+ * Only integer and pointer conversions are supported; %s would record the
+ * address of a string that may be gone by the time the ring is read.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __HOTLOG_H__
+#define __HOTLOG_H__
+
+#include <linux/build_bug.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+#define HOTLOG_LVL_ERR		0
+#define HOTLOG_LVL_WARN		1
+#define HOTLOG_LVL_INFO		2
+#define HOTLOG_LVL_DEBUG	3
+
+#ifndef HOTLOG_LEVEL
+#define HOTLOG_LEVEL		HOTLOG_LVL_INFO
+#endif
+
+#define HOTLOG_MAX_ARGS		4
+
+/* one per call site, registered on first use */
+struct hotlog_fmt {
+	u16 id;
+	u8 level;
+	u8 nargs;
+	const char *fmt;
+	const char *file;
+	unsigned int line;
+};
+
+/* ring record, layout shared with hotlog_decode.c */
+struct hotlog_rec {
+	u64 ts_ns;
+	u16 id;
+	u8 nargs;
+	u8 level;
+	u32 cpu;
+	u64 args[HOTLOG_MAX_ARGS];
+};
+
+void __hotlog_write(struct hotlog_fmt *fmt, const u64 *args);
+
+struct dentry;
+int hotlog_init(struct dentry *root);
+void hotlog_exit(void);
+
+#define __HOTLOG_ARG(x)			((u64)(unsigned long)(x))
+#define __hotlog_args0()
+#define __hotlog_args1(a)		__HOTLOG_ARG(a)
+#define __hotlog_args2(a, b)		__hotlog_args1(a), __HOTLOG_ARG(b)
+#define __hotlog_args3(a, b, c)		__hotlog_args2(a, b), __HOTLOG_ARG(c)
+#define __hotlog_args4(a, b, c, d)	__hotlog_args3(a, b, c), __HOTLOG_ARG(d)
+#define __hotlog_args(...) \
+	CONCATENATE(__hotlog_args, COUNT_ARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define __hotlog(lvl, _fmt, ...)					\
+do {									\
+	static struct hotlog_fmt __hl_fmt = {				\
+		.level = (lvl),						\
+		.nargs = COUNT_ARGS(__VA_ARGS__),			\
+		.fmt = (_fmt),						\
+		.file = __FILE__,					\
+		.line = __LINE__,					\
+	};								\
+	u64 __hl_args[HOTLOG_MAX_ARGS] = { __hotlog_args(__VA_ARGS__) };\
+									\
+	BUILD_BUG_ON(COUNT_ARGS(__VA_ARGS__) > HOTLOG_MAX_ARGS);	\
+	if (0)								\
+		printk(_fmt, ##__VA_ARGS__);				\
+	__hotlog_write(&__hl_fmt, __hl_args);				\
+} while (0)
+
+/* format-checked, never evaluated */
+#define __hotlog_none(_fmt, ...)					\
+do {									\
+	if (0)								\
+		printk(_fmt, ##__VA_ARGS__);				\
+} while (0)
+
+#if HOTLOG_LEVEL >= HOTLOG_LVL_ERR
+#define hotlog_err(fmt, ...)	__hotlog(HOTLOG_LVL_ERR, fmt, ##__VA_ARGS__)
+#else
+#define hotlog_err(fmt, ...)	__hotlog_none(fmt, ##__VA_ARGS__)
+#endif
+
+#if HOTLOG_LEVEL >= HOTLOG_LVL_WARN
+#define hotlog_warn(fmt, ...)	__hotlog(HOTLOG_LVL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define hotlog_warn(fmt, ...)	__hotlog_none(fmt, ##__VA_ARGS__)
+#endif
+
+#if HOTLOG_LEVEL >= HOTLOG_LVL_INFO
+#define hotlog_info(fmt, ...)	__hotlog(HOTLOG_LVL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define hotlog_info(fmt, ...)	__hotlog_none(fmt, ##__VA_ARGS__)
+#endif
+
+#if HOTLOG_LEVEL >= HOTLOG_LVL_DEBUG
+#define hotlog_dbg(fmt, ...)	__hotlog(HOTLOG_LVL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define hotlog_dbg(fmt, ...)	__hotlog_none(fmt, ##__VA_ARGS__)
+#endif
+
+#endif /* __HOTLOG_H__ */
@@ -0,0 +1,234 @@
+/*
+ * hotlog_decode - print the hotlog rings of my_debug_v4l2 as text
+ *
+ * Merges the per-CPU records by timestamp and formats each one with the
+ * format string registered for its call site (see hotlog.h).
+ *
+ *   ./hotlog_decode [-l max_level] [-d debugfs dir]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_DIR	"/sys/kernel/debug/my_debug_v4l2"
+#define MAX_FMTS	1024
+#define MAX_ARGS	4
+
+/* struct hotlog_rec in hotlog.h */
+struct rec {
+	uint64_t ts_ns;
+	uint16_t id;
+	uint8_t nargs;
+	uint8_t level;
+	uint32_t cpu;
+	uint64_t args[MAX_ARGS];
+};
+
+struct site {
+	unsigned int level, nargs;
+	char *where;
+	char *fmt;
+};
+
+static struct site sites[MAX_FMTS + 1];
+static const char * const level_names[] = { "E", "W", "I", "D" };
+
+static void unescape(char *s)
+{
+	char *d = s;
+
+	for (; *s; s++) {
+		if (*s == '\\' && s[1] == 'n') {
+			*d++ = '\n';
+			s++;
+		} else if (*s == '\\' && s[1] == '\\') {
+			*d++ = '\\';
+			s++;
+		} else {
+			*d++ = *s;
+		}
+	}
+	*d = '\0';
+}
+
+static int load_formats(const char *path)
+{
+	char line[1024], where[256];
+	unsigned int id, level, nargs;
+	int off;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (sscanf(line, "%u %u %u %255s %n", &id, &level, &nargs,
+				where, &off) < 4 || !id || id > MAX_FMTS)
+			continue;
+		sites[id].level = level;
+		sites[id].nargs = nargs;
+		sites[id].where = strdup(where);
+		sites[id].fmt = strdup(line + off);
+		unescape(sites[id].fmt);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/* print @fmt using the record's raw 64-bit arguments */
+static void format(const char *fmt, const struct rec *r)
+{
+	unsigned int arg = 0;
+	const char *p, *start;
+	char spec[32];
+	uint64_t v;
+	int len, wide;
+
+	for (p = fmt; *p; p++) {
+		if (*p != '%') {
+			putchar(*p);
+			continue;
+		}
+		if (p[1] == '%') {
+			putchar('%');
+			p++;
+			continue;
+		}
+
+		/* keep flags, width and precision; the length becomes ll */
+		start = p++;
+		while (*p && strchr("-+ #0123456789.", *p))
+			p++;
+		len = p - start;
+		for (wide = 0; *p && strchr("hlzjt", *p); p++)
+			wide |= *p != 'h';
+		if (!*p || len + 4 > (int)sizeof(spec))
+			break;
+
+		v = arg < r->nargs ? r->args[arg] : 0;
+		arg++;
+		/* int-sized arguments were widened to 64 bits on store */
+		if (!wide && *p != 'p')
+			v = *p == 'd' || *p == 'i' ?
+				(uint64_t)(int64_t)(int32_t)v : (uint32_t)v;
+
+		switch (*p) {
+		case 'd':
+		case 'i':
+			snprintf(spec, sizeof(spec), "%.*slld", len, start);
+			printf(spec, (long long)v);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			snprintf(spec, sizeof(spec), "%.*sll%c", len, start, *p);
+			printf(spec, (unsigned long long)v);
+			break;
+		case 'c':
+			snprintf(spec, sizeof(spec), "%.*sc", len, start);
+			printf(spec, (int)v);
+			break;
+		case 'p':
+			/* %pX extensions print as plain pointers */
+			printf("0x%llx", (unsigned long long)v);
+			while (p[1] && strchr("SsFfBKRrOo", p[1]))
+				p++;
+			break;
+		default:
+			printf("<%%%c?>", *p);
+			break;
+		}
+	}
+}
+
+static int cmp_ts(const void *a, const void *b)
+{
+	const struct rec *x = a, *y = b;
+
+	return (x->ts_ns > y->ts_ns) - (x->ts_ns < y->ts_ns);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = DEFAULT_DIR;
+	unsigned int max_level = 3;
+	struct rec *recs = NULL;
+	size_t n = 0, cap = 0, i;
+	char path[512];
+	FILE *f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:d:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			max_level = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-l max_level] [-d dir]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/hotlog_formats", dir);
+	if (load_formats(path))
+		return 1;
+
+	snprintf(path, sizeof(path), "%s/hotlog", dir);
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	for (;;) {
+		if (n == cap) {
+			cap = cap ? cap * 2 : 4096;
+			recs = realloc(recs, cap * sizeof(*recs));
+			if (!recs) {
+				perror("realloc");
+				return 1;
+			}
+		}
+		if (fread(&recs[n], sizeof(*recs), 1, f) != 1)
+			break;
+		n++;
+	}
+	fclose(f);
+
+	qsort(recs, n, sizeof(*recs), cmp_ts);
+
+	for (i = 0; i < n; i++) {
+		const struct rec *r = &recs[i];
+		const struct site *s;
+
+		if (r->id > MAX_FMTS || r->level > max_level)
+			continue;
+		s = &sites[r->id];
+		printf("[%6llu.%06llu] cpu%u %s ",
+			(unsigned long long)(r->ts_ns / 1000000000),
+			(unsigned long long)(r->ts_ns % 1000000000 / 1000),
+			r->cpu, level_names[r->level & 3]);
+		if (!s->fmt) {
+			printf("<unknown format %u>\n", r->id);
+			continue;
+		}
+		printf("%s: ", s->where);
+		format(s->fmt, r);
+		if (!strchr(s->fmt, '\n'))
+			putchar('\n');
+	}
+
+	free(recs);
+	return 0;
+}
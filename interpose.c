@@ -0,0 +1,340 @@
+/*
+ * interpose - shadow building, call accounting and restore for interpose.h
+ *
+ * debugfs file under the module root:
+ *   interpose  calls and latency of every wrapped callback
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/rculist.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include "interpose.h"
+
+static LIST_HEAD(interpose_tables);
+static DEFINE_MUTEX(interpose_lock);
+static DECLARE_WAIT_QUEUE_HEAD(interpose_idle);
+
+u64 interpose_enter(struct interpose_slot *slot)
+{
+	atomic_inc(&slot->table->active);
+	return ktime_get_ns();
+}
+
+void interpose_exit(struct interpose_slot *slot, u64 start_ns)
+{
+	s64 ns = ktime_get_ns() - start_ns;
+	s64 max = atomic64_read(&slot->max_ns);
+	s64 old;
+
+	atomic64_inc(&slot->calls);
+	atomic64_add(ns, &slot->total_ns);
+	while (ns > max) {
+		old = atomic64_cmpxchg(&slot->max_ns, max, ns);
+		if (old == max)
+			break;
+		max = old;
+	}
+
+	if (atomic_dec_and_test(&slot->table->active))
+		wake_up(&interpose_idle);
+}
+
+/*
+ * copy of @table standing in for, or made from, @ops; -1 if none. Retired
+ * copies only match their shadow unless @retired.
+ */
+static int interpose_find(struct interpose_table *table, const void *ops,
+		bool retired)
+{
+	unsigned int n = smp_load_acquire(&table->num_copies);
+	struct interpose_copy *copy;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		copy = &table->copies[i];
+		if (copy->shadow == ops ||
+		    ((retired || !READ_ONCE(copy->retired)) &&
+		     copy->orig_ops == ops))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Original of @slot behind @ops. @ops is what the caller reads through
+ * now: the shadow of this table, the shadow of a table stacked on top of
+ * it, or, once restored, the original itself.
+ */
+void *interpose_orig(struct interpose_slot *slot, const void *ops)
+{
+	struct interpose_table *table = slot->table, *other;
+	unsigned int depth;
+	void *fn = NULL;
+	int i;
+
+	if (!table || !ops)
+		return NULL;
+
+	rcu_read_lock();
+	for (depth = 0; depth < INTERPOSE_MAX_TABLES; depth++) {
+		i = interpose_find(table, ops, true);
+		if (i >= 0) {
+			fn = *(void * const *)(table->copies[i].orig_ops +
+					slot->offset);
+			goto out;
+		}
+		/* look through a table attached on top of this one */
+		list_for_each_entry_rcu(other, &interpose_tables, node) {
+			if (other == table)
+				continue;
+			i = interpose_find(other, ops, true);
+			if (i >= 0 && other->copies[i].shadow == ops)
+				break;
+		}
+		if (&other->node == &interpose_tables)
+			break;
+		ops = other->copies[i].orig_ops;
+	}
+	WARN_ONCE(1, "interpose: %s.%s called through unknown ops\n",
+		table->name, slot->name);
+out:
+	rcu_read_unlock();
+	return fn;
+}
+
+static int interpose_build(struct interpose_table *table, const void *ops)
+{
+	struct interpose_copy *copy;
+	struct interpose_slot *slot;
+	unsigned int i;
+	void **cb;
+	void *shadow;
+
+	if (table->num_copies == INTERPOSE_MAX_COPIES)
+		return -ENOSPC;
+
+	shadow = kmemdup(ops, table->size, GFP_KERNEL);
+	if (!shadow)
+		return -ENOMEM;
+
+	for (i = 0; i < table->num_slots; i++) {
+		slot = table->slots[i];
+		cb = shadow + slot->offset;
+		slot->table = table;
+		if (*cb)
+			slot->present = true;
+		if (*cb || slot->always)
+			*cb = slot->hook;
+	}
+
+	copy = &table->copies[table->num_copies];
+	copy->orig_ops = ops;
+	copy->shadow = shadow;
+	copy->retired = false;
+	if (!table->num_copies) {
+		atomic_set(&table->active, 0);
+		table->stuck = false;
+		list_add_tail_rcu(&table->node, &interpose_tables);
+	}
+	/* trampolines look copies up without the lock */
+	smp_store_release(&table->num_copies, table->num_copies + 1);
+
+	return table->num_copies - 1;
+}
+
+int interpose_attach(struct interpose_table *table, const void **site)
+{
+	const void *ops;
+	int ret = 0;
+	int i;
+
+	mutex_lock(&interpose_lock);
+	ops = READ_ONCE(*site);
+	if (!ops) {
+		ret = -EINVAL;
+		goto out;
+	}
+	i = interpose_find(table, ops, false);
+	/* the same ops are often reached from several channels */
+	if (i >= 0 && table->copies[i].shadow == ops)
+		goto out;
+	if (table->num_sites == INTERPOSE_MAX_SITES) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	if (i < 0) {
+		i = interpose_build(table, ops);
+		if (i < 0) {
+			ret = i;
+			goto out;
+		}
+	}
+
+	if (cmpxchg(site, ops, (const void *)table->copies[i].shadow) != ops) {
+		ret = -EAGAIN;
+		goto out;
+	}
+	table->sites[table->num_sites].site = site;
+	table->sites[table->num_sites].copy = i;
+	table->num_sites++;
+out:
+	mutex_unlock(&interpose_lock);
+	if (ret)
+		pr_warn("interpose: %s not attached (%d)\n", table->name, ret);
+	return ret;
+}
+
+/*
+ * Swap @site back to its original. The shadow stays allocated until
+ * interpose_restore_all(), callers may still be inside it. Returns 1 if
+ * no other site uses the shadow any more, which is then never handed out
+ * again: its original may go away with its module and a later one be
+ * loaded at the same address.
+ */
+int interpose_detach(struct interpose_table *table, const void **site)
+{
+	struct interpose_copy *copy;
+	unsigned int i, n;
+	int ret = -ENOENT;
+
+	mutex_lock(&interpose_lock);
+	for (i = 0; i < table->num_sites; i++)
+		if (table->sites[i].site == site)
+			break;
+	if (i == table->num_sites)
+		goto out;
+
+	copy = &table->copies[table->sites[i].copy];
+	if (cmpxchg(site, (const void *)copy->shadow, copy->orig_ops) !=
+			copy->shadow) {
+		pr_warn("interpose: %s site was re-pointed, left as is\n",
+			table->name);
+		table->stuck = true;
+	}
+	table->num_sites--;
+	memmove(&table->sites[i], &table->sites[i + 1],
+		(table->num_sites - i) * sizeof(table->sites[0]));
+
+	ret = 1;
+	for (n = 0; n < table->num_sites; n++)
+		if (&table->copies[table->sites[n].copy] == copy)
+			ret = 0;
+	if (ret)
+		WRITE_ONCE(copy->retired, true);
+out:
+	mutex_unlock(&interpose_lock);
+	return ret;
+}
+
+/* writable shadow of @table @site points at, NULL if none */
+void *interpose_shadow(struct interpose_table *table, const void **site)
+{
+	const void *ops = READ_ONCE(*site);
+	void *shadow = NULL;
+	int i;
+
+	mutex_lock(&interpose_lock);
+	i = ops ? interpose_find(table, ops, false) : -1;
+	if (i >= 0 && table->copies[i].shadow == ops)
+		shadow = table->copies[i].shadow;
+	mutex_unlock(&interpose_lock);
+
+	return shadow;
+}
+
+void interpose_restore_all(void)
+{
+	struct interpose_table *table, *tmp;
+	struct interpose_copy *copy;
+	unsigned int i;
+
+	mutex_lock(&interpose_lock);
+	/* inner tables may be attached inside outer shadows, undo in reverse */
+	list_for_each_entry_reverse(table, &interpose_tables, node) {
+		for (i = table->num_sites; i--; ) {
+			copy = &table->copies[table->sites[i].copy];
+			if (cmpxchg(table->sites[i].site,
+					(const void *)copy->shadow,
+					copy->orig_ops) == copy->shadow)
+				continue;
+			pr_warn("interpose: %s site %u was re-pointed, left as is\n",
+				table->name, i);
+			table->stuck = true;
+		}
+	}
+
+	/*
+	 * Trampolines are not RCU readers: a caller can be preempted between
+	 * loading a shadow pointer and interpose_enter(). Tasks RCU waits for
+	 * every task to pass a voluntary context switch, which a trampoline
+	 * never does outside the callback it counts as active.
+	 */
+	synchronize_rcu_tasks();
+
+	list_for_each_entry_reverse(table, &interpose_tables, node)
+		wait_event(interpose_idle, !atomic_read(&table->active));
+
+	/* trampolines still return through module text after the last exit */
+	synchronize_rcu_tasks();
+
+	list_for_each_entry_safe_reverse(table, tmp, &interpose_tables, node) {
+		/* whoever re-pointed a site may have copied the shadow */
+		for (i = 0; i < table->num_copies; i++) {
+			if (!table->stuck)
+				kfree(table->copies[i].shadow);
+			table->copies[i].shadow = NULL;
+		}
+		table->num_copies = 0;
+		table->num_sites = 0;
+		list_del_rcu(&table->node);
+	}
+	mutex_unlock(&interpose_lock);
+}
+
+static int interpose_show(struct seq_file *s, void *data)
+{
+	struct interpose_table *table;
+	struct interpose_slot *slot;
+	unsigned int i;
+	s64 calls, total;
+
+	seq_printf(s, "%-20s %-26s %10s %12s %10s %10s\n", "table",
+		"callback", "calls", "total_us", "avg_ns", "max_ns");
+
+	mutex_lock(&interpose_lock);
+	list_for_each_entry(table, &interpose_tables, node) {
+		for (i = 0; i < table->num_slots; i++) {
+			slot = table->slots[i];
+			if (!slot->present && !slot->always)
+				continue;
+			calls = atomic64_read(&slot->calls);
+			total = atomic64_read(&slot->total_ns);
+			seq_printf(s, "%-20s %-26s %10lld %12lld %10lld %10lld\n",
+				table->name, slot->name, calls,
+				div_s64(total, NSEC_PER_USEC),
+				calls ? div64_s64(total, calls) : 0,
+				(s64)atomic64_read(&slot->max_ns));
+		}
+	}
+	mutex_unlock(&interpose_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(interpose);
+
+void interpose_debugfs_init(struct dentry *root)
+{
+	if (root)
+		debugfs_create_file("interpose", 0444, root, NULL,
+				&interpose_fops);
+}
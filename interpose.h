@@ -0,0 +1,245 @@
+/*
+ * interpose - table-driven wrapping of kernel ops structures
+ *
+ * An interpose table names the callbacks of one ops structure type to
+ * wrap. Attaching it to a pointer that refers to an ops structure copies
+ * that structure into a shadow, points the wrapped members of the shadow
+ * at generated trampolines, and swaps the pointer to the shadow with a
+ * single cmpxchg. Every trampoline counts its calls and their latency,
+ * then calls either the original callback or a wrapper that calls it via
+ * INTERPOSE_ORIG(). interpose_restore_all() swaps every pointer back and
+ * waits for calls still inside a trampoline, and for the trampolines
+ * themselves to be left, before the shadows are freed.
+ *
+ *	INTERPOSE_CB(vi_ops, struct tegra_vi_fops, vi_power_on, int,
+ *		(struct tegra_channel *chan), (chan), chan->vi->fops);
+ *	INTERPOSE_TABLE(vi_ops, struct tegra_vi_fops,
+ *		INTERPOSE_SLOT(vi_ops, vi_power_on));
+ *	...
+ *	INTERPOSE_ATTACH(vi_ops, &chan->vi->fops);
+ *
+ * A table keeps one shadow per original structure it was attached to,
+ * so one table wraps the ops of several drivers, e.g. the v4l2_subdev_ops
+ * of every sensor. The last argument of each callback names, in terms of
+ * the callback's own parameters, the ops pointer the call came through;
+ * the trampoline and INTERPOSE_ORIG() use it to find the original of that
+ * very shadow. Tables stacked on one pointer are looked through.
+ *
+ * Members that are NULL in the original stay NULL unless the slot has a
+ * wrapper. Nested ops (v4l2_subdev_ops) are wrapped by attaching the
+ * inner table to a member of the outer table's shadow, see
+ * INTERPOSE_SHADOW(). INTERPOSE_DETACH() restores one pointer early, for
+ * ops owned by something that goes away before the module, such as an
+ * unbinding sub-device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __INTERPOSE_H__
+#define __INTERPOSE_H__
+
+#include <linux/atomic.h>
+#include <linux/build_bug.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/stddef.h>
+#include <linux/types.h>
+
+/* ops pointers one table can be attached to */
+#define INTERPOSE_MAX_SITES	32
+/* distinct original structures one table can wrap until restored */
+#define INTERPOSE_MAX_COPIES	16
+/* tables stacked on one ops pointer */
+#define INTERPOSE_MAX_TABLES	16
+
+struct interpose_table;
+
+struct interpose_slot {
+	const char *name;
+	size_t offset;
+	/* trampoline put in the shadow */
+	void *hook;
+	/* install even if the original member is NULL */
+	bool always;
+	/* set on attach */
+	bool present;
+	struct interpose_table *table;
+	atomic64_t calls;
+	atomic64_t total_ns;
+	atomic64_t max_ns;
+};
+
+/* one original structure and the shadow standing in for it */
+struct interpose_copy {
+	const void *orig_ops;
+	void *shadow;
+	/* detached from its last site, never reused for its orig_ops */
+	bool retired;
+};
+
+struct interpose_site {
+	const void **site;
+	unsigned int copy;
+};
+
+struct interpose_table {
+	const char *name;
+	size_t size;
+	struct interpose_slot * const *slots;
+	unsigned int num_slots;
+	/* set on attach, read locklessly by the trampolines */
+	struct interpose_copy copies[INTERPOSE_MAX_COPIES];
+	unsigned int num_copies;
+	struct interpose_site sites[INTERPOSE_MAX_SITES];
+	unsigned int num_sites;
+	/* a site did not point at the shadow any more on restore */
+	bool stuck;
+	atomic_t active;
+	struct list_head node;
+};
+
+u64 interpose_enter(struct interpose_slot *slot);
+void interpose_exit(struct interpose_slot *slot, u64 start_ns);
+void *interpose_orig(struct interpose_slot *slot, const void *ops);
+
+int interpose_attach(struct interpose_table *table, const void **site);
+int interpose_detach(struct interpose_table *table, const void **site);
+void *interpose_shadow(struct interpose_table *table, const void **site);
+void interpose_restore_all(void);
+
+struct dentry;
+void interpose_debugfs_init(struct dentry *root);
+
+#define __INTERPOSE_FN(tbl, member)	__ipt_##tbl##_##member##_fn
+#define INTERPOSE_SLOT(tbl, member)	(&__ipt_##tbl##_##member)
+
+/*
+ * original callback of @member behind the ops pointer @ops, for use
+ * inside its wrapper with the same expression the callback was declared
+ * with
+ */
+#define INTERPOSE_ORIG(tbl, member, ops)				\
+	((typeof(&__INTERPOSE_FN(tbl, member)))				\
+		interpose_orig(INTERPOSE_SLOT(tbl, member), (ops)))
+
+#define __INTERPOSE_DECLARE(tbl, type, member, always_, ret_t, proto)	\
+static ret_t __INTERPOSE_FN(tbl, member) proto;				\
+static struct interpose_slot __ipt_##tbl##_##member = {		\
+	.name = #member,						\
+	.offset = offsetof(type, member),				\
+	.hook = __INTERPOSE_FN(tbl, member),				\
+	.always = (always_),						\
+}
+
+#define __INTERPOSE_CB(tbl, type, member, wrap, always_, wrapper, ret_t,	\
+		proto, args, ops)					\
+__INTERPOSE_DECLARE(tbl, type, member, always_, ret_t, proto);		\
+static ret_t wrapper proto;						\
+static ret_t __INTERPOSE_FN(tbl, member) proto				\
+{									\
+	struct interpose_slot *__slot = INTERPOSE_SLOT(tbl, member);	\
+	ret_t (*__fn) proto = (wrap) ? wrapper :			\
+		INTERPOSE_ORIG(tbl, member, ops);			\
+	u64 __start;							\
+	ret_t __ret;							\
+									\
+	BUILD_BUG_ON(!__same_type(&__INTERPOSE_FN(tbl, member),	\
+			((type *)0)->member));				\
+	__start = interpose_enter(__slot);				\
+	__ret = __fn args;						\
+	interpose_exit(__slot, __start);				\
+	return __ret;							\
+}
+
+#define __INTERPOSE_CB_VOID(tbl, type, member, wrap, always_, wrapper,	\
+		proto, args, ops)					\
+__INTERPOSE_DECLARE(tbl, type, member, always_, void, proto);		\
+static void wrapper proto;						\
+static void __INTERPOSE_FN(tbl, member) proto				\
+{									\
+	struct interpose_slot *__slot = INTERPOSE_SLOT(tbl, member);	\
+	void (*__fn) proto = (wrap) ? wrapper :				\
+		INTERPOSE_ORIG(tbl, member, ops);			\
+	u64 __start;							\
+									\
+	BUILD_BUG_ON(!__same_type(&__INTERPOSE_FN(tbl, member),	\
+			((type *)0)->member));				\
+	__start = interpose_enter(__slot);				\
+	__fn args;							\
+	interpose_exit(__slot, __start);				\
+}
+
+/*
+ * Count and time @member of @type. @proto is the callback's parameter
+ * list in parentheses, @args the same names as a call argument list,
+ * @ops the ops pointer the call came through, e.g. vq->ops.
+ */
+#define INTERPOSE_CB(tbl, type, member, ret_t, proto, args, ops)	\
+	__INTERPOSE_CB(tbl, type, member, false, false,			\
+		__INTERPOSE_FN(tbl, member), ret_t, proto, args, ops)
+
+#define INTERPOSE_CB_VOID(tbl, type, member, proto, args, ops)		\
+	__INTERPOSE_CB_VOID(tbl, type, member, false, false,		\
+		__INTERPOSE_FN(tbl, member), proto, args, ops)
+
+/*
+ * As above, but call @wrapper instead of the original. The wrapper is
+ * declared here and defined by the caller; it must cope with a NULL
+ * INTERPOSE_ORIG() if the original structure lacks the member.
+ */
+#define INTERPOSE_CB_WRAP(tbl, type, member, wrapper, ret_t, proto, args, \
+		ops)							\
+	__INTERPOSE_CB(tbl, type, member, true, true, wrapper, ret_t,	\
+		proto, args, ops)
+
+#define INTERPOSE_CB_VOID_WRAP(tbl, type, member, wrapper, proto, args,	\
+		ops)							\
+	__INTERPOSE_CB_VOID(tbl, type, member, true, true, wrapper,	\
+		proto, args, ops)
+
+/*
+ * Wrapper installed only where the original has the member, so callers
+ * that test the member for NULL see the same ops as before.
+ */
+#define INTERPOSE_CB_AROUND(tbl, type, member, wrapper, ret_t, proto,	\
+		args, ops)						\
+	__INTERPOSE_CB(tbl, type, member, true, false, wrapper, ret_t,	\
+		proto, args, ops)
+
+#define INTERPOSE_CB_VOID_AROUND(tbl, type, member, wrapper, proto,	\
+		args, ops)						\
+	__INTERPOSE_CB_VOID(tbl, type, member, true, false, wrapper,	\
+		proto, args, ops)
+
+#define INTERPOSE_TABLE(tbl, type, ...)					\
+typedef type __ipt_##tbl##_t;						\
+static struct interpose_slot * const __ipt_##tbl##_slots[] = {		\
+	__VA_ARGS__							\
+};									\
+static struct interpose_table tbl = {					\
+	.name = #tbl,							\
+	.size = sizeof(type),						\
+	.slots = __ipt_##tbl##_slots,					\
+	.num_slots = ARRAY_SIZE(__ipt_##tbl##_slots),			\
+}
+
+#define __INTERPOSE_SITE(tbl, site)					\
+	((const void **)(site) +					\
+		BUILD_BUG_ON_ZERO(!__same_type(**(site), __ipt_##tbl##_t)))
+
+/* @site points at the ops pointer to swap, e.g. &notifier->ops */
+#define INTERPOSE_ATTACH(tbl, site)					\
+	interpose_attach(&(tbl), __INTERPOSE_SITE(tbl, site))
+
+/* swap @site back now, before whatever owns it goes away */
+#define INTERPOSE_DETACH(tbl, site)					\
+	interpose_detach(&(tbl), __INTERPOSE_SITE(tbl, site))
+
+/* writable shadow @site points at, NULL if @tbl is not attached there */
+#define INTERPOSE_SHADOW(tbl, site)					\
+	((__ipt_##tbl##_t *)interpose_shadow(&(tbl),			\
+		__INTERPOSE_SITE(tbl, site)))
+
+#endif /* __INTERPOSE_H__ */
@@ -15,12 +15,16 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
+#include <linux/timekeeping.h>
 #include <linux/types.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-fwnode.h>
 #include <media/v4l2-subdev.h>
 
+#include "ov428_snapshot.h"
+
 #define OV428_SC_MODE_SELECT            0x0100    //reset
 #define OV428_SC_MODE_SELECT_SW_STANDBY 0x0   //reset
 #define OV428_SC_MODE_SELECT_STREAMING          0x1  //reset
@@ -76,6 +80,10 @@ struct ov428 {
 	struct regulator *analog_regulator;
 
 	const struct ov428_mode_info *current_mode;
+	/* mode whose register table is loaded, NULL when unknown */
+	const struct ov428_mode_info *streamed_mode;
+	/* a control changed without reaching the sensor */
+	bool ctrls_dirty;
 
 	struct v4l2_ctrl_handler ctrls;
 	struct v4l2_ctrl *pixel_clock;
@@ -92,6 +100,10 @@ struct ov428 {
 	struct mutex lock; /* lock to protect power state, ctrls and mode */
 	bool power_on;
 
+	/* written under lock, read locklessly */
+	seqlock_t snap_lock;
+	struct ov428_snapshot snap;
+
 };
 
 static inline struct ov428 *to_ov428(struct v4l2_subdev *sd)
@@ -99,6 +111,68 @@ static inline struct ov428 *to_ov428(struct v4l2_subdev *sd)
 	return container_of(sd, struct ov428, sd);
 }
 
+/*
+ * Snapshot updates are made with ov428->lock held, between
+ * ov428_snap_begin() and ov428_snap_end().
+ */
+static void ov428_snap_begin(struct ov428 *ov428)
+{
+	write_seqlock(&ov428->snap_lock);
+}
+
+static void ov428_snap_end(struct ov428 *ov428)
+{
+	ov428->snap.seq++;
+	ov428->snap.updated_ns = ktime_get_ns();
+	write_sequnlock(&ov428->snap_lock);
+}
+
+static void ov428_snap_mode(struct ov428 *ov428)
+{
+	const struct ov428_mode_info *mode = ov428->current_mode;
+
+	ov428_snap_begin(ov428);
+	ov428->snap.width = mode->width;
+	ov428->snap.height = mode->height;
+	ov428->snap.interval_num = mode->timeperframe.numerator;
+	ov428->snap.interval_den = mode->timeperframe.denominator;
+	ov428_snap_end(ov428);
+}
+
+/*
+ * Publish the probe-time state. The controls are only written to the
+ * sensor at power on, so s_ctrl has not published exposure and gain yet.
+ */
+static void ov428_snap_init(struct ov428 *ov428)
+{
+	mutex_lock(&ov428->lock);
+	ov428_snap_begin(ov428);
+	if (ov428->current_mode) {
+		ov428->snap.width = ov428->current_mode->width;
+		ov428->snap.height = ov428->current_mode->height;
+		ov428->snap.interval_num =
+			ov428->current_mode->timeperframe.numerator;
+		ov428->snap.interval_den =
+			ov428->current_mode->timeperframe.denominator;
+	}
+	ov428->snap.exposure = ov428->exposure->val;
+	ov428->snap.gain = ov428->gain->val;
+	ov428->snap.streaming = 0;
+	ov428_snap_end(ov428);
+	mutex_unlock(&ov428->lock);
+}
+
+static void ov428_get_snapshot(struct ov428 *ov428,
+			       struct ov428_snapshot *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&ov428->snap_lock);
+		*snap = ov428->snap;
+	} while (read_seqretry(&ov428->snap_lock, seq));
+}
+
 static const struct reg_value ov428_global_init_setting[] = {
 	{ 0x0103, 0x01 },
 };
@@ -880,6 +954,9 @@ static int ov428_s_power(struct v4l2_subdev *sd, int on)
 		ov428_set_power_off(ov428);
 		ov428->power_on = false;
 	}
+	/* register contents are lost across a power cycle */
+	ov428->streamed_mode = NULL;
+	ov428->ctrls_dirty = true;
 
 exit:
 	mutex_unlock(&ov428->lock);
@@ -950,37 +1027,51 @@ static int ov428_s_ctrl(struct v4l2_ctrl *ctrl)
 	int ret;
 	/* v4l2_ctrl_lock() locks our mutex */
 
-	if (!ov428->power_on)
+	if (!ov428->power_on) {
+		ov428->ctrls_dirty = true;
 		return 0;
+	}
 
 	switch (ctrl->id) {
 	case V4L2_CID_EXPOSURE:
-		printk("1");
+		dev_dbg(ov428->dev, "s_ctrl exposure %d\n", ctrl->val);
 		ret = ov428_set_exposure(ov428, ctrl->val);
 		break;
 	case V4L2_CID_GAIN:
-		printk("2");
+		dev_dbg(ov428->dev, "s_ctrl gain %d\n", ctrl->val);
 		ret = ov428_set_gain(ov428, ctrl->val);
 		break;
 	case V4L2_CID_TEST_PATTERN:
-		printk("3");
+		dev_dbg(ov428->dev, "s_ctrl test pattern %d\n", ctrl->val);
 		ret = ov428_set_test_pattern(ov428, ctrl->val);
 		break;
 	case V4L2_CID_HFLIP:
-		printk("4");
+		dev_dbg(ov428->dev, "s_ctrl hflip %d\n", ctrl->val);
 		ret = ov428_set_hflip(ov428, ctrl->val);
 		break;
 	case V4L2_CID_VFLIP:
-		printk("5");
+		dev_dbg(ov428->dev, "s_ctrl vflip %d\n", ctrl->val);
 		ret = ov428_set_vflip(ov428, ctrl->val);
 		break;
 	default:
-		printk("6");
+		dev_warn(ov428->dev, "s_ctrl unknown ctrl 0x%x\n", ctrl->id);
 		ret = ov428_set_vflip(ov428, ctrl->val);
 		ret = -EINVAL;
 		break;
 	}
 
+	if (ret < 0) {
+		ov428->ctrls_dirty = true;
+	} else if (ctrl->id == V4L2_CID_EXPOSURE ||
+		   ctrl->id == V4L2_CID_GAIN) {
+		ov428_snap_begin(ov428);
+		if (ctrl->id == V4L2_CID_EXPOSURE)
+			ov428->snap.exposure = ctrl->val;
+		else
+			ov428->snap.gain = ctrl->val;
+		ov428_snap_end(ov428);
+	}
+
 	return ret;
 }
 
@@ -1166,6 +1257,7 @@ static int ov428_set_format(struct v4l2_subdev *sd,
 			goto exit;
 
 		ov428->current_mode = new_mode;
+		ov428_snap_mode(ov428);
 	}
 
 	__format = __ov428_get_pad_format(ov428, cfg, format->pad,
@@ -1230,19 +1322,32 @@ static int ov428_s_stream(struct v4l2_subdev *subdev, int enable)
 	mutex_lock(&ov428->lock);
 
 	if (enable) {
-		ret = ov428_set_register_array(ov428,
-					ov428->current_mode->data,
-					ov428->current_mode->data_size);
-		if (ret < 0) {
-			dev_err(ov428->dev, "could not set mode %dx%d\n",
-				ov428->current_mode->width,
-				ov428->current_mode->height);
-			goto exit;
+		/* a restart in the same mode finds the table still loaded */
+		if (ov428->streamed_mode != ov428->current_mode) {
+			ov428->streamed_mode = NULL;
+			ret = ov428_set_register_array(ov428,
+						ov428->current_mode->data,
+						ov428->current_mode->data_size);
+			if (ret < 0) {
+				dev_err(ov428->dev,
+					"could not set mode %dx%d\n",
+					ov428->current_mode->width,
+					ov428->current_mode->height);
+				goto exit;
+			}
+			ov428->streamed_mode = ov428->current_mode;
+			/* the mode table overwrites the control registers */
+			ov428->ctrls_dirty = true;
 		}
-		ret = __v4l2_ctrl_handler_setup(&ov428->ctrls);
-		if (ret < 0) {
-			dev_err(ov428->dev, "could not sync v4l2 controls\n");
-			goto exit;
+		if (ov428->ctrls_dirty) {
+			ov428->ctrls_dirty = false;
+			ret = __v4l2_ctrl_handler_setup(&ov428->ctrls);
+			if (ret < 0) {
+				ov428->ctrls_dirty = true;
+				dev_err(ov428->dev,
+					"could not sync v4l2 controls\n");
+				goto exit;
+			}
 		}
 		ret = ov428_write_reg(ov428, OV428_SC_MODE_SELECT,
 				       OV428_SC_MODE_SELECT_STREAMING);
@@ -1251,6 +1356,12 @@ static int ov428_s_stream(struct v4l2_subdev *subdev, int enable)
 				       OV428_SC_MODE_SELECT_SW_STANDBY);
 	}
 
+	if (!ret) {
+		ov428_snap_begin(ov428);
+		ov428->snap.streaming = enable;
+		ov428_snap_end(ov428);
+	}
+
 exit:
 	mutex_unlock(&ov428->lock);
 
@@ -1306,6 +1417,7 @@ static int ov428_set_frame_interval(struct v4l2_subdev *subdev,
 			goto exit;
 
 		ov428->current_mode = new_mode;
+		ov428_snap_mode(ov428);
 	}
 
 	fi->interval = ov428->current_mode->timeperframe;
@@ -1316,8 +1428,37 @@ exit:
 	return ret;
 }
 
+static long ov428_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
+{
+	switch (cmd) {
+	case OV428_IOC_G_SNAPSHOT:
+		ov428_get_snapshot(to_ov428(sd), arg);
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static ssize_t snapshot_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct v4l2_subdev *sd = i2c_get_clientdata(to_i2c_client(dev));
+	struct ov428_snapshot snap;
+
+	ov428_get_snapshot(to_ov428(sd), &snap);
+
+	return sprintf(buf,
+		       "%ux%u %u/%u exposure %d gain %d streaming %u seq %u updated_ns %llu\n",
+		       snap.width, snap.height, snap.interval_num,
+		       snap.interval_den, snap.exposure, snap.gain,
+		       snap.streaming, snap.seq,
+		       (unsigned long long)snap.updated_ns);
+}
+static DEVICE_ATTR_RO(snapshot);
+
 static const struct v4l2_subdev_core_ops ov428_core_ops = {
 	.s_power = ov428_s_power,
+	.ioctl = ov428_ioctl,
 };
 
 static const struct v4l2_subdev_video_ops ov428_video_ops = {
@@ -1417,6 +1558,7 @@ static int ov428_probe(struct i2c_client *client)
 	}
 */
 	mutex_init(&ov428->lock);
+	seqlock_init(&ov428->snap_lock);
 
 	v4l2_ctrl_handler_init(&ov428->ctrls, 7);
 	ov428->ctrls.lock = &ov428->lock;
@@ -1529,6 +1671,11 @@ static int ov428_probe(struct i2c_client *client)
 		goto free_entity;
 	}
 	ov428_entity_init_cfg(&ov428->sd, NULL);
+	ov428_snap_init(ov428);
+
+	/* optional, the ioctl still works without it */
+	if (device_create_file(dev, &dev_attr_snapshot))
+		dev_warn(dev, "could not create snapshot attribute\n");
 
 	return 0;
 power_down:
@@ -1547,6 +1694,7 @@ static int ov428_remove(struct i2c_client *client)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct ov428 *ov428 = to_ov428(sd);
 
+	device_remove_file(&client->dev, &dev_attr_snapshot);
 	v4l2_async_unregister_subdev(&ov428->sd);
 	media_entity_cleanup(&ov428->sd.entity);
 	v4l2_ctrl_handler_free(&ov428->ctrls);
@@ -0,0 +1,38 @@
+/*
+ * OV428 sensor state snapshot
+ *
+ * Current mode and the exposure/gain last written to the sensor, published
+ * by the driver under a seqlock so readers never wait for ov428->lock and
+ * the I2C sequences it covers. Read it with OV428_IOC_G_SNAPSHOT on the
+ * subdev node, or as text from the "snapshot" sysfs attribute of the I2C
+ * device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __OV428_SNAPSHOT_H__
+#define __OV428_SNAPSHOT_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+struct ov428_snapshot {
+	/* CLOCK_MONOTONIC time of the last update */
+	__u64 updated_ns;
+	/* number of updates since probe */
+	__u32 seq;
+	__u32 width;
+	__u32 height;
+	__u32 interval_num;
+	__u32 interval_den;
+	__s32 exposure;
+	__s32 gain;
+	__u32 streaming;
+};
+
+#define OV428_IOC_G_SNAPSHOT \
+	_IOR('V', BASE_VIDIOC_PRIVATE + 0, struct ov428_snapshot)
+
+#endif /* __OV428_SNAPSHOT_H__ */
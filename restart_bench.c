@@ -0,0 +1,250 @@
+/*
+ * restart_bench - STREAMOFF/STREAMON restart latency of a tegra channel
+ *
+ * Measures the time from VIDIOC_STREAMON to the first dequeued frame over
+ * a number of pause/resume cycles with an unchanged format, once with the
+ * "Warm Restart" control off (cold path) and once with it on.
+ *
+ *   ./restart_bench [-d /dev/video0] [-n cycles] [-f frames per cycle]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+/* TEGRA_CAMERA_CID_BASE from media/tegra-v4l2-camera.h */
+#define TEGRA_CAMERA_CID_BASE		(V4L2_CTRL_CLASS_CAMERA | 0x2000)
+#define TEGRA_CAMERA_CID_VI_WARM_RESTART	(TEGRA_CAMERA_CID_BASE + 125)
+
+#define NUM_BUFFERS	4
+
+struct buffer {
+	void *start;
+	size_t length;
+};
+
+static int fd;
+static struct buffer buffers[NUM_BUFFERS];
+static unsigned int num_buffers;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int xioctl(unsigned long req, void *arg)
+{
+	int ret;
+
+	do {
+		ret = ioctl(fd, req, arg);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+
+static int queue_all(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_buffers; i++) {
+		struct v4l2_buffer buf = {
+			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.memory = V4L2_MEMORY_MMAP,
+			.index = i,
+		};
+
+		if (xioctl(VIDIOC_QBUF, &buf) == -1) {
+			perror("VIDIOC_QBUF");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int dequeue_requeue(void)
+{
+	struct v4l2_buffer buf = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+
+	if (xioctl(VIDIOC_DQBUF, &buf) == -1) {
+		perror("VIDIOC_DQBUF");
+		return -1;
+	}
+	if (xioctl(VIDIOC_QBUF, &buf) == -1) {
+		perror("VIDIOC_QBUF");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int set_warm_restart(int on)
+{
+	struct v4l2_control ctrl = {
+		.id = TEGRA_CAMERA_CID_VI_WARM_RESTART,
+		.value = on,
+	};
+
+	if (xioctl(VIDIOC_S_CTRL, &ctrl) == -1) {
+		perror("warm restart control");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int setup_buffers(void)
+{
+	struct v4l2_requestbuffers req = {
+		.count = NUM_BUFFERS,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	unsigned int i;
+
+	if (xioctl(VIDIOC_REQBUFS, &req) == -1) {
+		perror("VIDIOC_REQBUFS");
+		return -1;
+	}
+	num_buffers = req.count < NUM_BUFFERS ? req.count : NUM_BUFFERS;
+
+	for (i = 0; i < num_buffers; i++) {
+		struct v4l2_buffer buf = {
+			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.memory = V4L2_MEMORY_MMAP,
+			.index = i,
+		};
+
+		if (xioctl(VIDIOC_QUERYBUF, &buf) == -1) {
+			perror("VIDIOC_QUERYBUF");
+			return -1;
+		}
+		buffers[i].length = buf.length;
+		buffers[i].start = mmap(NULL, buf.length,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+		if (buffers[i].start == MAP_FAILED) {
+			perror("mmap");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int run(const char *name, int warm, int cycles, int frames)
+{
+	int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	double *lat;
+	int c, i;
+
+	if (set_warm_restart(warm))
+		return -1;
+
+	lat = calloc(cycles, sizeof(*lat));
+	if (!lat)
+		return -1;
+
+	for (c = 0; c < cycles; c++) {
+		double start;
+
+		if (queue_all())
+			goto err;
+
+		start = now_us();
+		if (xioctl(VIDIOC_STREAMON, &type) == -1) {
+			perror("VIDIOC_STREAMON");
+			goto err;
+		}
+		if (dequeue_requeue())
+			goto err;
+		lat[c] = now_us() - start;
+
+		for (i = 1; i < frames; i++)
+			if (dequeue_requeue())
+				goto err;
+
+		if (xioctl(VIDIOC_STREAMOFF, &type) == -1) {
+			perror("VIDIOC_STREAMOFF");
+			goto err;
+		}
+	}
+
+	/* the first cycle always takes the cold path */
+	qsort(lat + 1, cycles - 1, sizeof(*lat), cmp_double);
+	printf("%-5s first %9.1f us  p50 %9.1f us  p90 %9.1f us  max %9.1f us\n",
+		name, lat[0], lat[1 + (cycles - 2) / 2],
+		lat[1 + (int)((cycles - 2) * 0.9)], lat[cycles - 1]);
+
+	free(lat);
+	return 0;
+
+err:
+	free(lat);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = "/dev/video0";
+	int cycles = 20, frames = 5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:n:f:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'n':
+			cycles = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-d device] [-n cycles] [-f frames]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (cycles < 2 || frames < 1) {
+		fprintf(stderr, "need at least 2 cycles and 1 frame\n");
+		return 1;
+	}
+
+	fd = open(dev, O_RDWR);
+	if (fd == -1) {
+		perror(dev);
+		return 1;
+	}
+
+	if (setup_buffers())
+		return 1;
+
+	printf("%s: %d restarts, %d frames each\n", dev, cycles, frames);
+	if (run("cold", 0, cycles, frames) || run("warm", 1, cycles, frames))
+		return 1;
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Tegra channel sensor properties blob
+ *
+ * Read-only snapshot of a sensor's mode table, built once per channel from
+ * camera_common_data::sensor_props and returned by the
+ * TEGRA_CAMERA_CID_SENSOR_PROPS_BLOB control in a single G_EXT_CTRLS.
+ *
+ * The blob starts with a header followed by one section per property
+ * kind. Each section is an array of num_modes records of entry_size bytes,
+ * so a section has the same layout as the legacy per-kind array control.
+ * Readers must check magic and version and locate sections through the
+ * offsets, never by assuming the struct sizes they were built with.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __SENSOR_PROPS_BLOB_H__
+#define __SENSOR_PROPS_BLOB_H__
+
+#include <linux/types.h>
+
+#define TEGRA_SENSOR_PROPS_BLOB_MAGIC	0x50534e54	/* "TNSP" */
+#define TEGRA_SENSOR_PROPS_BLOB_VERSION	1
+
+enum tegra_sensor_props_section {
+	TEGRA_SENSOR_PROPS_SIGNAL = 0,
+	TEGRA_SENSOR_PROPS_IMAGE,
+	TEGRA_SENSOR_PROPS_CONTROL,
+	TEGRA_SENSOR_PROPS_DV_TIMINGS,
+	TEGRA_SENSOR_PROPS_NUM_SECTIONS,
+};
+
+struct tegra_sensor_props_section_desc {
+	/* from the start of the blob, 8 byte aligned */
+	__u32 offset;
+	/* bytes per mode record */
+	__u32 entry_size;
+};
+
+struct tegra_sensor_props_blob_hdr {
+	__u32 magic;
+	__u32 version;
+	/* total blob size including this header */
+	__u32 size;
+	__u32 num_modes;
+	struct tegra_sensor_props_section_desc
+		sections[TEGRA_SENSOR_PROPS_NUM_SECTIONS];
+};
+
+#endif /* __SENSOR_PROPS_BLOB_H__ */
@@ -0,0 +1,228 @@
+/*
+ * snapshot_bench - ov428 state read latency under control traffic
+ *
+ * Reader threads repeatedly read exposure/gain from the sensor subdev,
+ * first with VIDIOC_G_CTRL (serialised on ov428->lock) and then with
+ * OV428_IOC_G_SNAPSHOT (seqlock), while a writer thread keeps the lock
+ * busy with VIDIOC_S_CTRL and VIDIOC_SUBDEV_S_FMT.
+ *
+ *   ./snapshot_bench [-d /dev/v4l-subdev0] [-t readers] [-s seconds]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/v4l2-subdev.h>
+
+#include "ov428_snapshot.h"
+
+#define MAX_READERS	64
+/* log2 nanosecond buckets */
+#define NUM_BUCKETS	40
+
+enum mode {
+	MODE_G_CTRL,
+	MODE_SNAPSHOT,
+};
+
+struct reader {
+	pthread_t thread;
+	enum mode mode;
+	uint64_t count;
+	uint64_t errors;
+	uint64_t max_ns;
+	uint64_t hist[NUM_BUCKETS];
+};
+
+static const char *dev = "/dev/v4l-subdev0";
+static volatile int stop;
+static int fd;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int read_g_ctrl(void)
+{
+	struct v4l2_control exp = { .id = V4L2_CID_EXPOSURE };
+	struct v4l2_control gain = { .id = V4L2_CID_GAIN };
+
+	if (ioctl(fd, VIDIOC_G_CTRL, &exp) == -1 ||
+	    ioctl(fd, VIDIOC_G_CTRL, &gain) == -1)
+		return -1;
+
+	return 0;
+}
+
+static int read_snapshot(void)
+{
+	struct ov428_snapshot snap;
+
+	return ioctl(fd, OV428_IOC_G_SNAPSHOT, &snap) == -1 ? -1 : 0;
+}
+
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	uint64_t t0, dt;
+	int ret, b;
+
+	while (!stop) {
+		t0 = now_ns();
+		ret = r->mode == MODE_G_CTRL ? read_g_ctrl() : read_snapshot();
+		dt = now_ns() - t0;
+
+		if (ret) {
+			r->errors++;
+			continue;
+		}
+		r->count++;
+		if (dt > r->max_ns)
+			r->max_ns = dt;
+		b = dt ? 63 - __builtin_clzll(dt) : 0;
+		r->hist[b < NUM_BUCKETS ? b : NUM_BUCKETS - 1]++;
+	}
+
+	return NULL;
+}
+
+static void *writer_fn(void *arg)
+{
+	struct v4l2_subdev_format fmt = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+	};
+	struct v4l2_control gain = { .id = V4L2_CID_GAIN };
+	uint64_t *writes = arg;
+	int i = 0;
+
+	if (ioctl(fd, VIDIOC_SUBDEV_G_FMT, &fmt) == -1)
+		perror("VIDIOC_SUBDEV_G_FMT");
+
+	while (!stop) {
+		gain.value = 16 + (i++ & 1);
+		ioctl(fd, VIDIOC_S_CTRL, &gain);
+		/* the same format still reprograms the mode controls */
+		ioctl(fd, VIDIOC_SUBDEV_S_FMT, &fmt);
+		(*writes)++;
+	}
+
+	return NULL;
+}
+
+/* upper bound of the bucket holding the p-th sample */
+static uint64_t percentile(const uint64_t *hist, uint64_t count, double p)
+{
+	uint64_t want = (uint64_t)(count * p), seen = 0;
+	int b;
+
+	for (b = 0; b < NUM_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen > want)
+			return 2ull << b;
+	}
+
+	return 0;
+}
+
+static int run(enum mode mode, int nreaders, int seconds)
+{
+	static const char * const names[] = { "G_CTRL", "snapshot" };
+	struct reader readers[MAX_READERS];
+	uint64_t hist[NUM_BUCKETS] = { 0 };
+	uint64_t count = 0, errors = 0, max_ns = 0, writes = 0;
+	pthread_t writer;
+	int i, b;
+
+	memset(readers, 0, sizeof(readers));
+	stop = 0;
+
+	if (pthread_create(&writer, NULL, writer_fn, &writes))
+		return -1;
+	for (i = 0; i < nreaders; i++) {
+		readers[i].mode = mode;
+		if (pthread_create(&readers[i].thread, NULL, reader_fn,
+				&readers[i]))
+			return -1;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	pthread_join(writer, NULL);
+	for (i = 0; i < nreaders; i++) {
+		pthread_join(readers[i].thread, NULL);
+		count += readers[i].count;
+		errors += readers[i].errors;
+		if (readers[i].max_ns > max_ns)
+			max_ns = readers[i].max_ns;
+		for (b = 0; b < NUM_BUCKETS; b++)
+			hist[b] += readers[i].hist[b];
+	}
+
+	if (errors && !count) {
+		fprintf(stderr, "%s: every read failed\n", names[mode]);
+		return -1;
+	}
+
+	printf("%-9s %10.0f reads/s  p50 <%8llu ns  p99 <%8llu ns  max %9llu ns  (%llu writer loops)\n",
+		names[mode], (double)count / seconds,
+		(unsigned long long)percentile(hist, count, 0.5),
+		(unsigned long long)percentile(hist, count, 0.99),
+		(unsigned long long)max_ns, (unsigned long long)writes);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nreaders = 4, seconds = 5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:t:s:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 't':
+			nreaders = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-d subdev] [-t readers] [-s seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nreaders < 1 || nreaders > MAX_READERS || seconds < 1) {
+		fprintf(stderr, "readers must be 1..%d, seconds >= 1\n",
+			MAX_READERS);
+		return 1;
+	}
+
+	fd = open(dev, O_RDWR);
+	if (fd == -1) {
+		perror(dev);
+		return 1;
+	}
+
+	printf("%s: %d readers, %d s per mode\n", dev, nreaders, seconds);
+	if (run(MODE_G_CTRL, nreaders, seconds) ||
+	    run(MODE_SNAPSHOT, nreaders, seconds))
+		return 1;
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,572 @@
+/*
+ * sw_sensor - synthetic sensor sub-device
+ *
+ * A v4l2_subdev with one source pad and the pad ops of ov428.c whose mode
+ * table comes from module parameters, so graph build, format negotiation
+ * and streaming can be driven at any resolution and rate without a
+ * sensor on the bus. Nothing is captured.
+ *
+ *   sw_sensor_modes="1920x1080@60,3840x2160@30:SRGGB10"
+ *
+ * Each mode is WIDTHxHEIGHT@FPS with an optional bus code name, modes
+ * without one use sw_sensor_code. The sub-device sits on its own platform
+ * device and registers with v4l2_async. It is matched by device name from
+ * the fake notifier, or, with sw_sensor_of_node set, takes the fwnode of
+ * that DT node so the notifier that expects the sensor there binds it
+ * instead (load it in place of the real driver).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <media/media-entity.h>
+#include <media/v4l2-async.h>
+#include <media/v4l2-subdev.h>
+
+#include "debug_v4l2.h"
+
+static bool sw_sensor_enable;
+module_param(sw_sensor_enable, bool, 0444);
+MODULE_PARM_DESC(sw_sensor_enable, "register the synthetic sensor");
+
+static char *sw_sensor_modes = "1920x1080@30,1920x1080@60,3840x2160@30";
+module_param(sw_sensor_modes, charp, 0444);
+MODULE_PARM_DESC(sw_sensor_modes,
+	"comma separated WIDTHxHEIGHT@FPS[:CODE] modes, the first is the default");
+
+static char *sw_sensor_code = "Y10";
+module_param(sw_sensor_code, charp, 0444);
+MODULE_PARM_DESC(sw_sensor_code, "bus code of modes that name none");
+
+static char *sw_sensor_of_node;
+module_param(sw_sensor_of_node, charp, 0444);
+MODULE_PARM_DESC(sw_sensor_of_node,
+	"DT path of the sensor node to stand in for, matched by fwnode");
+
+#define SW_SENSOR_MAX_MODES	32
+
+struct sw_sensor_code {
+	const char *name;
+	u32 code;
+};
+
+static const struct sw_sensor_code sw_sensor_codes[] = {
+	{ "Y8", MEDIA_BUS_FMT_Y8_1X8 },
+	{ "Y10", MEDIA_BUS_FMT_Y10_1X10 },
+	{ "Y12", MEDIA_BUS_FMT_Y12_1X12 },
+	{ "SRGGB8", MEDIA_BUS_FMT_SRGGB8_1X8 },
+	{ "SRGGB10", MEDIA_BUS_FMT_SRGGB10_1X10 },
+	{ "SRGGB12", MEDIA_BUS_FMT_SRGGB12_1X12 },
+	{ "SBGGR10", MEDIA_BUS_FMT_SBGGR10_1X10 },
+	{ "SBGGR12", MEDIA_BUS_FMT_SBGGR12_1X12 },
+	{ "SGBRG10", MEDIA_BUS_FMT_SGBRG10_1X10 },
+	{ "SGRBG10", MEDIA_BUS_FMT_SGRBG10_1X10 },
+	{ "UYVY", MEDIA_BUS_FMT_UYVY8_1X16 },
+	{ "YUYV", MEDIA_BUS_FMT_YUYV8_1X16 },
+};
+
+struct sw_sensor_mode {
+	u32 width;
+	u32 height;
+	u32 code;
+	struct v4l2_fract timeperframe;
+};
+
+struct sw_sensor {
+	struct platform_device *pdev;
+	struct v4l2_subdev sd;
+	struct media_pad pad;
+	/* serializes the pad and video ops */
+	struct mutex lock;
+	struct v4l2_mbus_framefmt fmt;
+	const struct sw_sensor_mode *current_mode;
+	bool streaming;
+	unsigned int num_modes;
+	struct sw_sensor_mode modes[SW_SENSOR_MAX_MODES];
+};
+
+static struct sw_sensor *sw_sensor;
+
+static inline struct sw_sensor *to_sw_sensor(struct v4l2_subdev *sd)
+{
+	return container_of(sd, struct sw_sensor, sd);
+}
+
+static inline u32 avg_fps(const struct v4l2_fract *t)
+{
+	return (t->denominator + (t->numerator >> 1)) / t->numerator;
+}
+
+static int sw_sensor_parse_code(const char *name, u32 *code)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sw_sensor_codes); i++) {
+		if (!strcasecmp(name, sw_sensor_codes[i].name)) {
+			*code = sw_sensor_codes[i].code;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int sw_sensor_parse_modes(struct sw_sensor *sensor)
+{
+	struct sw_sensor_mode *mode;
+	char *buf, *cur, *tok, *name;
+	u32 def_code, fps;
+	int ret = 0;
+
+	if (sw_sensor_parse_code(sw_sensor_code, &def_code)) {
+		pr_err("sw_sensor: unknown bus code %s\n", sw_sensor_code);
+		return -EINVAL;
+	}
+
+	buf = kstrdup(sw_sensor_modes, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	cur = buf;
+	while ((tok = strsep(&cur, ",")) != NULL) {
+		tok = strim(tok);
+		if (!*tok)
+			continue;
+		if (sensor->num_modes == SW_SENSOR_MAX_MODES) {
+			ret = -E2BIG;
+			break;
+		}
+
+		mode = &sensor->modes[sensor->num_modes];
+		name = strchr(tok, ':');
+		if (name)
+			*name++ = '\0';
+		if (sscanf(tok, "%ux%u@%u", &mode->width, &mode->height,
+				&fps) != 3 || !mode->width || !mode->height ||
+				!fps) {
+			ret = -EINVAL;
+			break;
+		}
+		mode->code = def_code;
+		if (name && sw_sensor_parse_code(name, &mode->code)) {
+			ret = -EINVAL;
+			break;
+		}
+		mode->timeperframe.numerator = 1;
+		mode->timeperframe.denominator = fps;
+		sensor->num_modes++;
+	}
+	if (!ret && !sensor->num_modes)
+		ret = -EINVAL;
+	if (ret)
+		pr_err("sw_sensor: bad mode \"%s\" (%d)\n", tok ? tok : "",
+			ret);
+
+	kfree(buf);
+	return ret;
+}
+
+/* closest size with @code, among those the closest rate to @fps */
+static const struct sw_sensor_mode *
+sw_sensor_find_mode(struct sw_sensor *sensor, u32 code, u32 width,
+		u32 height, u32 fps)
+{
+	const struct sw_sensor_mode *best = NULL, *mode;
+	u32 dist, best_dist = U32_MAX, fps_dist, best_fps_dist = U32_MAX;
+	unsigned int i;
+
+	for (i = 0; i < sensor->num_modes; i++) {
+		mode = &sensor->modes[i];
+		if (mode->code != code)
+			continue;
+
+		dist = abs((s32)mode->width - (s32)width) +
+			abs((s32)mode->height - (s32)height);
+		fps_dist = abs((s32)avg_fps(&mode->timeperframe) - (s32)fps);
+		if (dist < best_dist ||
+		    (dist == best_dist && fps_dist < best_fps_dist)) {
+			best = mode;
+			best_dist = dist;
+			best_fps_dist = fps_dist;
+		}
+	}
+
+	return best;
+}
+
+static void sw_sensor_fill_fmt(const struct sw_sensor_mode *mode,
+		struct v4l2_mbus_framefmt *fmt)
+{
+	memset(fmt, 0, sizeof(*fmt));
+	fmt->width = mode->width;
+	fmt->height = mode->height;
+	fmt->code = mode->code;
+	fmt->field = V4L2_FIELD_NONE;
+	fmt->colorspace = V4L2_COLORSPACE_SRGB;
+	fmt->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(fmt->colorspace);
+	fmt->quantization = V4L2_MAP_QUANTIZATION_DEFAULT(true,
+				fmt->colorspace, fmt->ycbcr_enc);
+	fmt->xfer_func = V4L2_MAP_XFER_FUNC_DEFAULT(fmt->colorspace);
+}
+
+static int sw_sensor_enum_mbus_code(struct v4l2_subdev *sd,
+				    struct v4l2_subdev_pad_config *cfg,
+				    struct v4l2_subdev_mbus_code_enum *code)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	unsigned int index = code->index;
+	unsigned int i, j;
+
+	/* every code once, in the order the modes first use it */
+	for (i = 0; i < sensor->num_modes; i++) {
+		for (j = 0; j < i; j++)
+			if (sensor->modes[j].code == sensor->modes[i].code)
+				break;
+		if (j < i)
+			continue;
+		if (index-- == 0) {
+			code->code = sensor->modes[i].code;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int sw_sensor_enum_frame_size(struct v4l2_subdev *sd,
+				     struct v4l2_subdev_pad_config *cfg,
+				     struct v4l2_subdev_frame_size_enum *fse)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	const struct sw_sensor_mode *mode;
+	unsigned int index = fse->index;
+	unsigned int i, j;
+
+	/* sizes repeat for every rate they have, list each once */
+	for (i = 0; i < sensor->num_modes; i++) {
+		mode = &sensor->modes[i];
+		if (mode->code != fse->code)
+			continue;
+		for (j = 0; j < i; j++)
+			if (sensor->modes[j].code == mode->code &&
+			    sensor->modes[j].width == mode->width &&
+			    sensor->modes[j].height == mode->height)
+				break;
+		if (j < i)
+			continue;
+		if (index-- == 0) {
+			fse->min_width = mode->width;
+			fse->max_width = mode->width;
+			fse->min_height = mode->height;
+			fse->max_height = mode->height;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int sw_sensor_enum_frame_ival(struct v4l2_subdev *sd,
+				     struct v4l2_subdev_pad_config *cfg,
+				     struct v4l2_subdev_frame_interval_enum *fie)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	unsigned int index = fie->index;
+	unsigned int i;
+
+	for (i = 0; i < sensor->num_modes; i++) {
+		if (fie->code != sensor->modes[i].code ||
+		    fie->width != sensor->modes[i].width ||
+		    fie->height != sensor->modes[i].height)
+			continue;
+
+		if (index-- == 0) {
+			fie->interval = sensor->modes[i].timeperframe;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static struct v4l2_mbus_framefmt *
+__sw_sensor_get_pad_format(struct sw_sensor *sensor,
+			   struct v4l2_subdev_pad_config *cfg,
+			   unsigned int pad,
+			   enum v4l2_subdev_format_whence which)
+{
+	switch (which) {
+	case V4L2_SUBDEV_FORMAT_TRY:
+		return v4l2_subdev_get_try_format(&sensor->sd, cfg, pad);
+	case V4L2_SUBDEV_FORMAT_ACTIVE:
+		return &sensor->fmt;
+	default:
+		return NULL;
+	}
+}
+
+static int sw_sensor_get_format(struct v4l2_subdev *sd,
+				struct v4l2_subdev_pad_config *cfg,
+				struct v4l2_subdev_format *format)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	struct v4l2_mbus_framefmt *__format;
+
+	mutex_lock(&sensor->lock);
+	__format = __sw_sensor_get_pad_format(sensor, cfg, format->pad,
+					      format->which);
+	if (__format)
+		format->format = *__format;
+	mutex_unlock(&sensor->lock);
+
+	return __format ? 0 : -EINVAL;
+}
+
+static int sw_sensor_set_format(struct v4l2_subdev *sd,
+				struct v4l2_subdev_pad_config *cfg,
+				struct v4l2_subdev_format *format)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	struct v4l2_mbus_framefmt *__format;
+	const struct sw_sensor_mode *new_mode;
+	int ret = 0;
+	u32 fps;
+
+	mutex_lock(&sensor->lock);
+	fps = avg_fps(&sensor->current_mode->timeperframe);
+
+	__format = __sw_sensor_get_pad_format(sensor, cfg, format->pad,
+					      format->which);
+	if (!__format) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	/* an unsupported code falls back to the current one */
+	new_mode = sw_sensor_find_mode(sensor, format->format.code,
+				format->format.width, format->format.height,
+				fps);
+	if (!new_mode)
+		new_mode = sw_sensor_find_mode(sensor,
+				sensor->current_mode->code,
+				format->format.width, format->format.height,
+				fps);
+
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		if (sensor->streaming && new_mode != sensor->current_mode) {
+			ret = -EBUSY;
+			goto exit;
+		}
+		sensor->current_mode = new_mode;
+	}
+
+	sw_sensor_fill_fmt(new_mode, __format);
+	format->format = *__format;
+
+exit:
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
+static int sw_sensor_entity_init_cfg(struct v4l2_subdev *sd,
+				     struct v4l2_subdev_pad_config *cfg)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	struct v4l2_subdev_format fmt = {
+		.which = cfg ? V4L2_SUBDEV_FORMAT_TRY
+			     : V4L2_SUBDEV_FORMAT_ACTIVE,
+	};
+
+	sw_sensor_fill_fmt(&sensor->modes[0], &fmt.format);
+	sw_sensor_set_format(sd, cfg, &fmt);
+
+	return 0;
+}
+
+static int sw_sensor_get_frame_interval(struct v4l2_subdev *sd,
+					struct v4l2_subdev_frame_interval *fi)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+
+	mutex_lock(&sensor->lock);
+	fi->interval = sensor->current_mode->timeperframe;
+	mutex_unlock(&sensor->lock);
+
+	return 0;
+}
+
+static int sw_sensor_set_frame_interval(struct v4l2_subdev *sd,
+					struct v4l2_subdev_frame_interval *fi)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+	const struct sw_sensor_mode *mode;
+	int ret = 0;
+
+	if (!fi->interval.numerator || !fi->interval.denominator)
+		return -EINVAL;
+
+	mutex_lock(&sensor->lock);
+	mode = sensor->current_mode;
+	mode = sw_sensor_find_mode(sensor, mode->code, mode->width,
+			mode->height, avg_fps(&fi->interval));
+	if (sensor->streaming && mode != sensor->current_mode) {
+		ret = -EBUSY;
+		goto exit;
+	}
+	sensor->current_mode = mode;
+	fi->interval = mode->timeperframe;
+
+exit:
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
+static int sw_sensor_s_stream(struct v4l2_subdev *sd, int enable)
+{
+	struct sw_sensor *sensor = to_sw_sensor(sd);
+
+	mutex_lock(&sensor->lock);
+	sensor->streaming = enable;
+	dev_dbg(sd->dev, "stream %s %ux%u@%u\n", enable ? "on" : "off",
+		sensor->current_mode->width, sensor->current_mode->height,
+		avg_fps(&sensor->current_mode->timeperframe));
+	mutex_unlock(&sensor->lock);
+
+	return 0;
+}
+
+static const struct v4l2_subdev_video_ops sw_sensor_video_ops = {
+	.s_stream = sw_sensor_s_stream,
+	.g_frame_interval = sw_sensor_get_frame_interval,
+	.s_frame_interval = sw_sensor_set_frame_interval,
+};
+
+static const struct v4l2_subdev_pad_ops sw_sensor_pad_ops = {
+	.init_cfg = sw_sensor_entity_init_cfg,
+	.enum_mbus_code = sw_sensor_enum_mbus_code,
+	.enum_frame_size = sw_sensor_enum_frame_size,
+	.enum_frame_interval = sw_sensor_enum_frame_ival,
+	.get_fmt = sw_sensor_get_format,
+	.set_fmt = sw_sensor_set_format,
+};
+
+static const struct v4l2_subdev_ops sw_sensor_subdev_ops = {
+	.video = &sw_sensor_video_ops,
+	.pad = &sw_sensor_pad_ops,
+};
+
+/* device name the fake notifier matches, NULL if it should not */
+const char *sw_sensor_devname(void)
+{
+	if (!sw_sensor || sw_sensor_of_node)
+		return NULL;
+
+	return dev_name(&sw_sensor->pdev->dev);
+}
+
+int sw_sensor_init(void)
+{
+	struct sw_sensor *sensor;
+	struct device_node *np;
+	int ret;
+
+	if (!sw_sensor_enable)
+		return 0;
+
+	sensor = kzalloc(sizeof(*sensor), GFP_KERNEL);
+	if (!sensor)
+		return -ENOMEM;
+	mutex_init(&sensor->lock);
+
+	ret = sw_sensor_parse_modes(sensor);
+	if (ret)
+		goto err_free;
+
+	sensor->pdev = platform_device_register_simple("sw_sensor", -1,
+			NULL, 0);
+	if (IS_ERR(sensor->pdev)) {
+		ret = PTR_ERR(sensor->pdev);
+		goto err_free;
+	}
+
+	v4l2_subdev_init(&sensor->sd, &sw_sensor_subdev_ops);
+	sensor->sd.owner = THIS_MODULE;
+	sensor->sd.dev = &sensor->pdev->dev;
+	sensor->sd.flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	snprintf(sensor->sd.name, sizeof(sensor->sd.name), "sw_sensor %s",
+		dev_name(&sensor->pdev->dev));
+	v4l2_set_subdevdata(&sensor->sd, sensor);
+
+	/* the device keeps no of_node, channel.c finds no camera_common */
+	if (sw_sensor_of_node) {
+		np = of_find_node_by_path(sw_sensor_of_node);
+		if (!np) {
+			pr_err("sw_sensor: no DT node %s\n", sw_sensor_of_node);
+			ret = -ENODEV;
+			goto err_pdev;
+		}
+		sensor->sd.fwnode = of_fwnode_handle(np);
+	}
+
+	sensor->current_mode = &sensor->modes[0];
+	sw_sensor_entity_init_cfg(&sensor->sd, NULL);
+
+	sensor->pad.flags = MEDIA_PAD_FL_SOURCE;
+	sensor->sd.entity.function = MEDIA_ENT_F_CAM_SENSOR;
+	ret = media_entity_pads_init(&sensor->sd.entity, 1, &sensor->pad);
+	if (ret < 0)
+		goto err_node;
+
+	ret = v4l2_async_register_subdev(&sensor->sd);
+	if (ret < 0) {
+		dev_err(&sensor->pdev->dev, "could not register v4l2 device\n");
+		goto err_entity;
+	}
+
+	dev_info(&sensor->pdev->dev, "%u modes, default %ux%u@%u\n",
+		sensor->num_modes, sensor->modes[0].width,
+		sensor->modes[0].height,
+		avg_fps(&sensor->modes[0].timeperframe));
+	sw_sensor = sensor;
+
+	return 0;
+
+err_entity:
+	media_entity_cleanup(&sensor->sd.entity);
+err_node:
+	if (sensor->sd.fwnode)
+		of_node_put(to_of_node(sensor->sd.fwnode));
+err_pdev:
+	platform_device_unregister(sensor->pdev);
+err_free:
+	mutex_destroy(&sensor->lock);
+	kfree(sensor);
+	return ret;
+}
+
+void sw_sensor_exit(void)
+{
+	struct sw_sensor *sensor = sw_sensor;
+
+	if (!sensor)
+		return;
+
+	sw_sensor = NULL;
+	v4l2_async_unregister_subdev(&sensor->sd);
+	media_entity_cleanup(&sensor->sd.entity);
+	if (sw_sensor_of_node)
+		of_node_put(to_of_node(sensor->sd.fwnode));
+	platform_device_unregister(sensor->pdev);
+	mutex_destroy(&sensor->lock);
+	kfree(sensor);
+}
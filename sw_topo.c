@@ -0,0 +1,316 @@
+/*
+ * sw_topo - synthetic large-topology graph build benchmark
+ *
+ * Builds a SerDes shaped topology of N fake entities - deserializers,
+ * each fed by `fanin` serializers with one sensor behind every serializer
+ * - and times the steps of a graph build on it: indexing the entity list
+ * by device_node, resolving the remote entity of every link through the
+ * index and creating the media links. The same lookups are also timed
+ * with the linear list walk the index replaced, so both can be compared
+ * at topology sizes no board has.
+ *
+ * The entities are struct tegra_vi_graph_entity like the ones the VI
+ * core parses from DT, with a unique fake device_node each, and media
+ * entities registered on a private media_device that is never exposed.
+ * Nothing touches the hardware or the real graph.
+ *
+ * debugfs file under the module root:
+ *   sw_topo  write "ENTITIES [FANIN]" to run, read the last result
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include <media/mc_common.h>
+#include <media/media-device.h>
+#include <media/media-entity.h>
+
+#include "debug_v4l2.h"
+
+/* the linear walk is quadratic, keep a run within a few seconds */
+#define SW_TOPO_MAX_ENTITIES	16384
+#define SW_TOPO_MAX_FANIN	16
+#define SW_TOPO_DEFAULT_FANIN	4
+
+struct sw_topo_ent {
+	struct tegra_vi_graph_entity gent;
+	struct media_entity entity;
+	struct media_pad *pads;
+	char name[32];
+	/* downstream entity and its sink pad, -1 for none */
+	int remote;
+	u16 remote_pad;
+};
+
+struct sw_topo_result {
+	unsigned int entities;
+	unsigned int fanin;
+	unsigned int links;
+	s64 index_ns;
+	s64 lookup_ns;
+	s64 linear_ns;
+	s64 link_ns;
+	int ret;
+};
+
+static DEFINE_MUTEX(sw_topo_lock);
+static struct sw_topo_result sw_topo_last;
+
+/* the lookup tegra_vi_graph_find_entity() did before the index */
+static struct tegra_vi_graph_entity *
+sw_topo_find_linear(struct list_head *entities,
+		const struct device_node *node)
+{
+	struct tegra_vi_graph_entity *entity;
+
+	list_for_each_entry(entity, entities, list)
+		if (entity->node == node)
+			return entity;
+
+	return NULL;
+}
+
+/*
+ * Lay the entities out as groups of one deserializer followed by `fanin`
+ * serializer/sensor pairs. A deserializer has a sink pad per serializer
+ * and one source pad, the last group may be cut short.
+ */
+static int sw_topo_generate(struct media_device *mdev,
+		struct sw_topo_ent *ents, struct device_node *nodes,
+		unsigned int num, unsigned int fanin, struct list_head *list)
+{
+	unsigned int group = 1 + 2 * fanin;
+	unsigned int i, p, pos, num_pads;
+	struct sw_topo_ent *ent;
+	int ret;
+
+	for (i = 0; i < num; i++) {
+		ent = &ents[i];
+		pos = i % group;
+		ent->remote = -1;
+		ent->gent.node = &nodes[i];
+
+		if (!pos) {
+			snprintf(ent->name, sizeof(ent->name),
+				"sw-topo-des-%u", i / group);
+			ent->entity.function = MEDIA_ENT_F_VID_IF_BRIDGE;
+			num_pads = fanin + 1;
+		} else if (pos & 1) {
+			snprintf(ent->name, sizeof(ent->name),
+				"sw-topo-ser-%u", i);
+			ent->entity.function = MEDIA_ENT_F_VID_IF_BRIDGE;
+			ent->remote = i - pos;
+			ent->remote_pad = pos / 2;
+			num_pads = 2;
+		} else {
+			snprintf(ent->name, sizeof(ent->name),
+				"sw-topo-sensor-%u", i);
+			ent->entity.function = MEDIA_ENT_F_CAM_SENSOR;
+			ent->remote = i - 1;
+			ent->remote_pad = 0;
+			num_pads = 1;
+		}
+
+		ent->pads = kcalloc(num_pads, sizeof(*ent->pads), GFP_KERNEL);
+		if (!ent->pads)
+			return -ENOMEM;
+		for (p = 0; p + 1 < num_pads; p++)
+			ent->pads[p].flags = MEDIA_PAD_FL_SINK;
+		ent->pads[num_pads - 1].flags = MEDIA_PAD_FL_SOURCE;
+
+		ent->entity.name = ent->name;
+		ret = media_entity_pads_init(&ent->entity, num_pads, ent->pads);
+		if (ret < 0)
+			return ret;
+		ret = media_device_register_entity(mdev, &ent->entity);
+		if (ret < 0)
+			return ret;
+
+		ent->gent.entity = &ent->entity;
+		list_add_tail(&ent->gent.list, list);
+	}
+
+	return 0;
+}
+
+static void sw_topo_release(struct media_device *mdev,
+		struct sw_topo_ent *ents, unsigned int num)
+{
+	unsigned int i;
+
+	/* unregistering an entity removes its links as well */
+	for (i = 0; i < num; i++) {
+		if (ents[i].entity.graph_obj.mdev)
+			media_device_unregister_entity(&ents[i].entity);
+		kfree(ents[i].pads);
+	}
+	media_device_cleanup(mdev);
+}
+
+static int sw_topo_run(unsigned int num, unsigned int fanin,
+		struct sw_topo_result *res)
+{
+	struct tegra_vi_graph_entity *found;
+	struct tegra_vi_graph_index idx;
+	struct tegra_vi_graph_entity **remote;
+	struct media_device *mdev;
+	struct device_node *nodes;
+	struct sw_topo_ent *ents, *ent;
+	LIST_HEAD(list);
+	unsigned int i;
+	ktime_t start;
+	int ret;
+
+	memset(res, 0, sizeof(*res));
+	res->entities = num;
+	res->fanin = fanin;
+
+	mdev = kzalloc(sizeof(*mdev), GFP_KERNEL);
+	ents = kvcalloc(num, sizeof(*ents), GFP_KERNEL);
+	nodes = kvcalloc(num, sizeof(*nodes), GFP_KERNEL);
+	remote = kvcalloc(num, sizeof(*remote), GFP_KERNEL);
+	if (!mdev || !ents || !nodes || !remote) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	strscpy(mdev->model, "sw_topo", sizeof(mdev->model));
+	media_device_init(mdev);
+
+	ret = sw_topo_generate(mdev, ents, nodes, num, fanin, &list);
+	if (ret < 0)
+		goto release;
+
+	start = ktime_get();
+	ret = my_tegra_vi_graph_index_build(&list, &idx);
+	res->index_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (ret < 0)
+		goto release;
+
+	start = ktime_get();
+	for (i = 0; i < num; i++) {
+		if (ents[i].remote < 0)
+			continue;
+		remote[i] = my_tegra_vi_graph_find_entity(&idx,
+				ents[ents[i].remote].gent.node);
+	}
+	res->lookup_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	my_tegra_vi_graph_index_free(&idx);
+
+	start = ktime_get();
+	for (i = 0; i < num; i++) {
+		if (ents[i].remote < 0)
+			continue;
+		found = sw_topo_find_linear(&list,
+				ents[ents[i].remote].gent.node);
+		if (!found || found != remote[i]) {
+			pr_err("sw_topo: %s resolves differently\n",
+				ents[i].name);
+			ret = -EINVAL;
+			goto release;
+		}
+		cond_resched();
+	}
+	res->linear_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < num; i++) {
+		ent = &ents[i];
+		if (ent->remote < 0)
+			continue;
+		ret = media_create_pad_link(&ent->entity,
+				ent->entity.num_pads - 1,
+				remote[i]->entity, ent->remote_pad,
+				MEDIA_LNK_FL_ENABLED);
+		if (ret < 0)
+			goto release;
+		res->links++;
+	}
+	res->link_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+release:
+	sw_topo_release(mdev, ents, num);
+free:
+	kvfree(remote);
+	kvfree(nodes);
+	kvfree(ents);
+	kfree(mdev);
+	res->ret = ret;
+
+	return ret;
+}
+
+static int sw_topo_show(struct seq_file *s, void *data)
+{
+	struct sw_topo_result *res = &sw_topo_last;
+
+	mutex_lock(&sw_topo_lock);
+	if (res->entities)
+		seq_printf(s, "entities %u fanin %u links %u ret %d\n"
+			"index_ns %lld lookup_ns %lld linear_ns %lld link_ns %lld\n"
+			"build_ns %lld\n",
+			res->entities, res->fanin, res->links, res->ret,
+			res->index_ns, res->lookup_ns, res->linear_ns,
+			res->link_ns,
+			res->index_ns + res->lookup_ns + res->link_ns);
+	mutex_unlock(&sw_topo_lock);
+
+	return 0;
+}
+
+static int sw_topo_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sw_topo_show, inode->i_private);
+}
+
+static ssize_t sw_topo_write(struct file *file, const char __user *ubuf,
+		size_t count, loff_t *ppos)
+{
+	unsigned int num, fanin = SW_TOPO_DEFAULT_FANIN;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &num, &fanin) < 1)
+		return -EINVAL;
+	if (!num || num > SW_TOPO_MAX_ENTITIES ||
+			!fanin || fanin > SW_TOPO_MAX_FANIN)
+		return -EINVAL;
+
+	mutex_lock(&sw_topo_lock);
+	ret = sw_topo_run(num, fanin, &sw_topo_last);
+	mutex_unlock(&sw_topo_lock);
+
+	return ret < 0 ? ret : count;
+}
+
+static const struct file_operations sw_topo_fops = {
+	.owner = THIS_MODULE,
+	.open = sw_topo_open,
+	.read = seq_read,
+	.write = sw_topo_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void sw_topo_debugfs_init(struct dentry *root)
+{
+	if (root)
+		debugfs_create_file("sw_topo", 0644, root, NULL,
+			&sw_topo_fops);
+}
@@ -0,0 +1,129 @@
+/*
+ * Tegra channel extension members
+ *
+ * State this tree's channel.c keeps per channel and per buffer on top of
+ * the vendor struct tegra_channel and struct tegra_channel_buffer.
+ * channel.c replaces the vendor drivers/media/platform/tegra/camera/vi/
+ * channel.c and is built into the kernel, so the kernel has to be rebuilt
+ * with this header and the vendor nvidia/include/media/mc_common.h
+ * changed as follows:
+ *
+ *  1. copy this file to nvidia/include/media/tegra_channel_ext.h
+ *  2. in mc_common.h, include it after the other includes:
+ *
+ *	#include <media/tegra_channel_ext.h>
+ *
+ *  3. add the members as the LAST member of each structure, so that the
+ *     offsets of every vendor member stay as they are:
+ *
+ *	struct tegra_channel_buffer {
+ *		...
+ *		TEGRA_CHANNEL_BUFFER_EXT_FIELDS
+ *	};
+ *
+ *	struct tegra_channel {
+ *		...
+ *		TEGRA_CHANNEL_EXT_FIELDS
+ *	};
+ *
+ *  4. copy channel.c over the vendor file and rebuild the kernel.
+ *
+ * my_debug_v4l2.ko is built against the installed, possibly stock,
+ * mc_common.h and must never touch these members.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __TEGRA_CHANNEL_EXT_H__
+#define __TEGRA_CHANNEL_EXT_H__
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/wait.h>
+#include <media/videobuf2-v4l2.h>
+
+struct tegra_channel_buffer;
+struct tegra_channel_fmt_index;
+struct tegra_channel_try_cache;
+struct tegra_channel_ctrl_cache;
+struct sensor_mode_properties;
+struct v4l2_ctrl_handler;
+struct video_device;
+
+/* log2 buckets: bucket 0 counts zero, bucket n counts [2^(n-1), 2^n) */
+#define TEGRA_RECOVERY_HIST_BUCKETS	16
+
+enum tegra_channel_recovery_tier {
+	TEGRA_RECOVERY_LIGHT = 0,
+	TEGRA_RECOVERY_FULL,
+	TEGRA_RECOVERY_ESCALATED,
+	/* the channel reset itself failed */
+	TEGRA_RECOVERY_FAILED,
+	TEGRA_RECOVERY_NUM,
+};
+
+/* what to do with frames arriving while user-space holds every buffer */
+enum tegra_channel_drop_policy {
+	TEGRA_DROP_POLICY_BLOCK = 0,
+	TEGRA_DROP_POLICY_DROP_NEWEST,
+	TEGRA_DROP_POLICY_DROP_OLDEST,
+	TEGRA_DROP_POLICY_NUM,
+};
+
+#define TEGRA_CHANNEL_BUFFER_EXT_FIELDS					\
+	/* request bundle already applied to the sensor */		\
+	bool req_applied;						\
+	/* metadata buffer of the same frame */			\
+	struct tegra_channel_buffer *emb_buf;				\
+	/* trace key of the frame the buffer is armed for */		\
+	u32 frame_seq;
+
+#define TEGRA_CHANNEL_EXT_FIELDS					\
+	/* next trace frame key, never reset so keys stay unique */	\
+	u32 frame_seq;							\
+	/* VIDIOC_*_MPLANE queue with one plane, set from DT */	\
+	bool multiplanar;						\
+	/* embedded data metadata node */				\
+	struct video_device *emb_video;					\
+	struct vb2_queue emb_queue;					\
+	struct mutex emb_video_lock;					\
+	spinlock_t emb_lock;						\
+	struct list_head emb_capture;					\
+	struct list_head emb_active;					\
+	wait_queue_head_t emb_wait;					\
+	/* the VI's scratch emb_buf while a metadata buffer is lent */	\
+	dma_addr_t emb_scratch;						\
+	/* frame drop policy */						\
+	u32 drop_policy;						\
+	u32 drop_count[TEGRA_DROP_POLICY_NUM];				\
+	u32 drop_episodes[TEGRA_DROP_POLICY_NUM];			\
+	bool drop_starved;						\
+	/* frames the sensor takes to latch a request's controls */	\
+	u32 req_latency;						\
+	/* error recovery accounting */					\
+	bool recovery_pending;						\
+	u32 recovery_count[TEGRA_RECOVERY_NUM];				\
+	u32 recovery_time_hist[TEGRA_RECOVERY_HIST_BUCKETS];		\
+	u32 recovery_lost_hist[TEGRA_RECOVERY_HIST_BUCKETS];		\
+	/* format lookup and TRY_FMT memo */				\
+	struct tegra_channel_fmt_index *fmt_index;			\
+	struct tegra_channel_try_cache *try_cache;			\
+	/* warm stream restart */					\
+	bool warm_restart;						\
+	bool warm_valid;						\
+	u32 warm_sig;							\
+	bool clknbw_held;						\
+	/* sensor mode table blob */					\
+	void *props_blob;						\
+	const struct sensor_mode_properties *props_blob_src;		\
+	/* incremental control handler */				\
+	struct v4l2_ctrl_handler *ctrl_hdls[MAX_SUBDEVICES];		\
+	struct tegra_channel_ctrl_cache *ctrl_cache;			\
+	bool ctrls_built;						\
+	/* enum tegra_channel_gang_split */				\
+	u32 gang_split;
+
+#endif /* __TEGRA_CHANNEL_EXT_H__ */
@@ -0,0 +1,54 @@
+/*
+ * Tegra channel gang mode sizing
+ *
+ * How many CSI bricks a sensor mode needs, kept free of kernel-only
+ * dependencies so gang_test can check it from userspace.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#ifndef __TEGRA_GANG_H__
+#define __TEGRA_GANG_H__
+
+#include <linux/types.h>
+
+#ifdef __KERNEL__
+#include <linux/math64.h>
+#else
+static inline __u64 div64_u64(__u64 dividend, __u64 divisor)
+{
+	return dividend / divisor;
+}
+#endif
+
+/* number of lanes per brick */
+#define NUM_LANES_PER_BRICK	4
+/* D-PHY lane rate ceiling, sets the pixel capacity of a brick */
+#define TEGRA_CSI_LANE_MAX_BPS	2500000000ULL
+
+/*
+ * Number of CSI bricks a stream needs: enough for its lanes, and enough
+ * that no brick carries more pixels than NUM_LANES_PER_BRICK lanes at
+ * TEGRA_CSI_LANE_MAX_BPS can deliver.
+ */
+static inline __u32 tegra_channel_gang_bricks(__u64 pixel_rate,
+		__u32 num_lanes, __u32 bits_per_pixel)
+{
+	__u32 bricks = (num_lanes + NUM_LANES_PER_BRICK - 1) /
+			NUM_LANES_PER_BRICK;
+	__u64 brick_rate, rate_bricks;
+
+	if (bits_per_pixel) {
+		brick_rate = div64_u64(TEGRA_CSI_LANE_MAX_BPS *
+				NUM_LANES_PER_BRICK, bits_per_pixel);
+		rate_bricks = div64_u64(pixel_rate + brick_rate - 1,
+				brick_rate);
+		if (rate_bricks > bricks)
+			bricks = rate_bricks;
+	}
+
+	return bricks ? bricks : 1;
+}
+
+#endif /* __TEGRA_GANG_H__ */
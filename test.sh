@@ -6,3 +6,4 @@ make
 sudo insmod my_debug_v4l2.ko
 sleep 1
 sudo dmesg -c
+[ -x ./evring_dump ] && sudo ./evring_dump
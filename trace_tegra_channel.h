@@ -0,0 +1,138 @@
+/*
+ * Tegra channel per-frame lifecycle tracepoints
+ *
+ * Every event carries the channel id and the vb2 buffer index. Events
+ * of a captured frame also carry its frame key, assigned when a buffer
+ * is armed for capture and unique per channel, so a frame can be followed
+ * from VIDIOC_QBUF to vb2_buffer_done even though buffer indices are
+ * reused:
+ *
+ *   buf_queue -> capture_submit -> sof -> eof -> ring_release -> vb2_done
+ *
+ * buf_queue precedes the arming and has only the index. vb2_done also
+ * carries the V4L2 sequence handed to user-space.
+ *
+ * capture_submit only fires on the release-list path, once the capture
+ * descriptor has been submitted. Ring-path fops program the VI directly
+ * and have no submit event.
+ *
+ * sof carries the start of frame time in CLOCK_MONOTONIC ns. On the ring
+ * path it fires at the frame start, on the release-list path only when
+ * the frame is released, so its sof_ns is the time to use.
+ *
+ * trace_timeline.c consumes these from the trace buffer.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tegra_channel
+
+#if !defined(_TRACE_TEGRA_CHANNEL_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_TEGRA_CHANNEL_H
+
+#include <linux/tracepoint.h>
+#include <media/videobuf2-core.h>
+
+/* buffer handed to the driver by VIDIOC_QBUF */
+TRACE_EVENT(tegra_channel_buf_queue,
+	TP_PROTO(u32 chan_id, u32 index),
+	TP_ARGS(chan_id, index),
+	TP_STRUCT__entry(
+		__field(u32, chan_id)
+		__field(u32, index)
+	),
+	TP_fast_assign(
+		__entry->chan_id = chan_id;
+		__entry->index = index;
+	),
+	TP_printk("chan=%u index=%u", __entry->chan_id, __entry->index)
+);
+
+DECLARE_EVENT_CLASS(tegra_channel_frame,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame),
+	TP_ARGS(chan_id, index, frame),
+	TP_STRUCT__entry(
+		__field(u32, chan_id)
+		__field(u32, index)
+		__field(u32, frame)
+	),
+	TP_fast_assign(
+		__entry->chan_id = chan_id;
+		__entry->index = index;
+		__entry->frame = frame;
+	),
+	TP_printk("chan=%u index=%u frame=%u",
+		__entry->chan_id, __entry->index, __entry->frame)
+);
+
+/* capture descriptor for the buffer submitted to the VI */
+DEFINE_EVENT(tegra_channel_frame, tegra_channel_capture_submit,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame),
+	TP_ARGS(chan_id, index, frame)
+);
+
+/* start of frame received for the buffer */
+TRACE_EVENT(tegra_channel_sof,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame, u64 sof_ns),
+	TP_ARGS(chan_id, index, frame, sof_ns),
+	TP_STRUCT__entry(
+		__field(u32, chan_id)
+		__field(u32, index)
+		__field(u32, frame)
+		__field(u64, sof_ns)
+	),
+	TP_fast_assign(
+		__entry->chan_id = chan_id;
+		__entry->index = index;
+		__entry->frame = frame;
+		__entry->sof_ns = sof_ns;
+	),
+	TP_printk("chan=%u index=%u frame=%u sof_ns=%llu",
+		__entry->chan_id, __entry->index, __entry->frame,
+		__entry->sof_ns)
+);
+
+/* end of frame, buffer timestamped */
+DEFINE_EVENT(tegra_channel_frame, tegra_channel_eof,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame),
+	TP_ARGS(chan_id, index, frame)
+);
+
+/* buffer taken off the capture ring or release list */
+DEFINE_EVENT(tegra_channel_frame, tegra_channel_ring_release,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame),
+	TP_ARGS(chan_id, index, frame)
+);
+
+/* buffer returned to videobuf2, error unless it completed as DONE */
+TRACE_EVENT(tegra_channel_vb2_done,
+	TP_PROTO(u32 chan_id, u32 index, u32 frame, u32 sequence, int state),
+	TP_ARGS(chan_id, index, frame, sequence, state),
+	TP_STRUCT__entry(
+		__field(u32, chan_id)
+		__field(u32, index)
+		__field(u32, frame)
+		__field(u32, sequence)
+		__field(bool, error)
+	),
+	TP_fast_assign(
+		__entry->chan_id = chan_id;
+		__entry->index = index;
+		__entry->frame = frame;
+		__entry->sequence = sequence;
+		__entry->error = state != VB2_BUF_STATE_DONE;
+	),
+	TP_printk("chan=%u index=%u frame=%u seq=%u error=%d",
+		__entry->chan_id, __entry->index, __entry->frame,
+		__entry->sequence, __entry->error)
+);
+
+#endif /* _TRACE_TEGRA_CHANNEL_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace_tegra_channel
+#include <trace/define_trace.h>
@@ -0,0 +1,353 @@
+/*
+ * trace_timeline - per-frame latency breakdown of tegra channel captures
+ *
+ * Reads the tegra_channel:* tracepoints (see trace_tegra_channel.h) from
+ * the ftrace buffer and reports, per channel, the latency distribution of
+ * every lifecycle stage and the capture stalls.
+ *
+ *   echo 1 > /sys/kernel/tracing/events/tegra_channel/enable
+ *   ... stream ...
+ *   ./trace_timeline [-s stall_factor] [trace file | -]
+ *
+ * Stages of a capture are followed per (channel, frame key), so a reused
+ * buffer index never mixes two frames up. The queue that armed a frame
+ * and the application hold after it are joined on the buffer index,
+ * which belongs to a single frame between its done and its next queue:
+ *
+ *   queue -> submit -> sof -> eof -> release -> done -> queue
+ *   driver   hardware hardware driver  driver   application
+ *
+ * The sof stage uses the hardware start of frame time from the event.
+ * Set the trace clock to match it first:
+ *
+ *   echo mono > /sys/kernel/tracing/trace_clock
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_TRACE	"/sys/kernel/tracing/trace"
+#define MAX_CHANNELS	64
+#define MAX_BUFFERS	64
+/* frames in flight per channel, far more than any queue depth */
+#define FRAME_SLOTS	1024
+
+enum stage {
+	STAGE_QUEUE,
+	STAGE_SUBMIT,
+	STAGE_SOF,
+	STAGE_EOF,
+	STAGE_RELEASE,
+	STAGE_DONE,
+	NUM_STAGES,
+};
+
+static const char * const stage_events[NUM_STAGES] = {
+	"tegra_channel_buf_queue",
+	"tegra_channel_capture_submit",
+	"tegra_channel_sof",
+	"tegra_channel_eof",
+	"tegra_channel_ring_release",
+	"tegra_channel_vb2_done",
+};
+
+/* interval ending at stage i; STAGE_QUEUE is done -> requeue */
+static const char * const interval_names[NUM_STAGES] = {
+	"app hold (done->queue)",
+	"queued (queue->submit)",
+	"armed (submit->sof)",
+	"exposure (sof->eof)",
+	"ring (eof->release)",
+	"release (release->done)",
+};
+
+struct samples {
+	double *v;
+	size_t n, cap;
+};
+
+struct frame {
+	int used;
+	unsigned int key;
+	double t[NUM_STAGES];
+};
+
+struct channel {
+	int used;
+	/* last queue and done per buffer index */
+	double queued[MAX_BUFFERS];
+	double done[MAX_BUFFERS];
+	struct frame frames[FRAME_SLOTS];
+	struct samples interval[NUM_STAGES];
+	struct samples sof_ts;
+	unsigned long errors;
+};
+
+static struct channel channels[MAX_CHANNELS];
+
+static void push(struct samples *s, double v)
+{
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 256;
+		s->v = realloc(s->v, s->cap * sizeof(*s->v));
+		if (!s->v) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	s->v[s->n++] = v;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double pct(const struct samples *s, double p)
+{
+	size_t i = (size_t)(p * (s->n - 1) + 0.5);
+
+	return s->v[i];
+}
+
+struct event {
+	double ts;
+	int stage;
+	unsigned int chan, index, frame;
+	unsigned long long sof_ns;
+	int error;
+};
+
+static int parse_line(const char *line, struct event *e)
+{
+	const char *ev, *p;
+	unsigned int seq;
+	int i, n;
+
+	ev = strstr(line, ": tegra_channel_");
+	if (!ev)
+		return -1;
+
+	/* timestamp is the last token before the event name */
+	p = ev;
+	while (p > line && p[-1] != ' ')
+		p--;
+	if (sscanf(p, "%lf", &e->ts) != 1)
+		return -1;
+
+	ev += 2;
+	for (i = 0; i < NUM_STAGES; i++) {
+		size_t len = strlen(stage_events[i]);
+
+		if (!strncmp(ev, stage_events[i], len) && ev[len] == ':')
+			break;
+	}
+	if (i == NUM_STAGES)
+		return -1;
+
+	e->stage = i;
+	e->error = 0;
+	e->sof_ns = 0;
+	p = strchr(ev, ':') + 1;
+	switch (i) {
+	case STAGE_QUEUE:
+		n = sscanf(p, " chan=%u index=%u", &e->chan, &e->index) - 2;
+		break;
+	case STAGE_SOF:
+		n = sscanf(p, " chan=%u index=%u frame=%u sof_ns=%llu",
+			&e->chan, &e->index, &e->frame, &e->sof_ns) - 4;
+		break;
+	case STAGE_DONE:
+		n = sscanf(p, " chan=%u index=%u frame=%u seq=%u error=%d",
+			&e->chan, &e->index, &e->frame, &seq, &e->error) - 5;
+		break;
+	default:
+		n = sscanf(p, " chan=%u index=%u frame=%u",
+			&e->chan, &e->index, &e->frame) - 3;
+		break;
+	}
+	if (n)
+		return -1;
+	if (e->chan >= MAX_CHANNELS || e->index >= MAX_BUFFERS)
+		return -1;
+
+	return 0;
+}
+
+/* intervals between the stages a frame went through, some are skipped */
+static void account_frame(struct channel *ch, const struct frame *f)
+{
+	int prev = -1, i;
+
+	for (i = STAGE_QUEUE; i <= STAGE_DONE; i++) {
+		if (f->t[i] == 0.0)
+			continue;
+		if (prev >= 0 && f->t[i] >= f->t[prev])
+			push(&ch->interval[i], (f->t[i] - f->t[prev]) * 1e6);
+		prev = i;
+	}
+}
+
+static void account(const struct event *e)
+{
+	struct channel *ch = &channels[e->chan];
+	struct frame *f;
+	double ts = e->ts;
+
+	ch->used = 1;
+	if (e->stage == STAGE_QUEUE) {
+		/* interval ending at queue: the application hold */
+		if (ch->done[e->index] != 0.0 && ts >= ch->done[e->index])
+			push(&ch->interval[STAGE_QUEUE],
+				(ts - ch->done[e->index]) * 1e6);
+		ch->done[e->index] = 0.0;
+		ch->queued[e->index] = ts;
+		return;
+	}
+
+	f = &ch->frames[e->frame % FRAME_SLOTS];
+	if (!f->used || f->key != e->frame) {
+		memset(f, 0, sizeof(*f));
+		f->used = 1;
+		f->key = e->frame;
+		/* the queue this index was waiting on armed this frame */
+		f->t[STAGE_QUEUE] = ch->queued[e->index];
+		ch->queued[e->index] = 0.0;
+	}
+
+	if (e->stage == STAGE_SOF && e->sof_ns) {
+		ts = e->sof_ns / 1e9;
+		push(&ch->sof_ts, ts);
+	} else if (e->stage == STAGE_SOF) {
+		push(&ch->sof_ts, ts);
+	}
+	f->t[e->stage] = ts;
+
+	if (e->stage == STAGE_DONE) {
+		/* events of a frame may arrive out of stage order */
+		account_frame(ch, f);
+		f->used = 0;
+		ch->done[e->index] = e->ts;
+		if (e->error)
+			ch->errors++;
+	}
+}
+
+static void report_stalls(struct channel *ch, double factor)
+{
+	struct samples gaps = { 0 };
+	double median, limit;
+	unsigned long stalls = 0;
+	double worst = 0.0, worst_at = 0.0;
+	size_t i;
+
+	if (ch->sof_ts.n < 3)
+		return;
+
+	/* release-list sof events fire late, order them by frame start */
+	qsort(ch->sof_ts.v, ch->sof_ts.n, sizeof(double), cmp_double);
+	for (i = 1; i < ch->sof_ts.n; i++)
+		push(&gaps, ch->sof_ts.v[i] - ch->sof_ts.v[i - 1]);
+	qsort(gaps.v, gaps.n, sizeof(double), cmp_double);
+	median = pct(&gaps, 0.5);
+	limit = median * factor;
+
+	for (i = 1; i < ch->sof_ts.n; i++) {
+		double gap = ch->sof_ts.v[i] - ch->sof_ts.v[i - 1];
+
+		if (gap <= limit)
+			continue;
+		stalls++;
+		if (gap > worst) {
+			worst = gap;
+			worst_at = ch->sof_ts.v[i - 1];
+		}
+	}
+
+	printf("  frame interval median %.3f ms, %lu stalls > %.1fx",
+		median * 1e3, stalls, factor);
+	if (stalls)
+		printf(", worst %.3f ms at %.6f", worst * 1e3, worst_at);
+	printf("\n");
+	free(gaps.v);
+}
+
+static void report(double factor)
+{
+	unsigned int c;
+	int i;
+
+	for (c = 0; c < MAX_CHANNELS; c++) {
+		struct channel *ch = &channels[c];
+
+		if (!ch->used)
+			continue;
+
+		printf("channel %u: %zu frames, %lu errors\n", c,
+			ch->interval[STAGE_DONE].n, ch->errors);
+		printf("  %-26s %8s %10s %10s %10s %10s\n", "stage (us)",
+			"count", "p50", "p90", "p99", "max");
+		for (i = 0; i < NUM_STAGES; i++) {
+			struct samples *s = &ch->interval[(i + 1) % NUM_STAGES];
+
+			if (!s->n)
+				continue;
+			qsort(s->v, s->n, sizeof(double), cmp_double);
+			printf("  %-26s %8zu %10.1f %10.1f %10.1f %10.1f\n",
+				interval_names[(i + 1) % NUM_STAGES], s->n,
+				pct(s, 0.5), pct(s, 0.9), pct(s, 0.99),
+				s->v[s->n - 1]);
+		}
+		report_stalls(ch, factor);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = DEFAULT_TRACE;
+	double factor = 1.5;
+	char line[1024];
+	FILE *f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:h")) != -1) {
+		switch (opt) {
+		case 's':
+			factor = atof(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-s stall_factor] [trace | -]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		struct event e;
+
+		if (line[0] == '#')
+			continue;
+		if (parse_line(line, &e))
+			continue;
+		account(&e);
+	}
+
+	if (f != stdin)
+		fclose(f);
+
+	report(factor);
+
+	return 0;
+}